@@ -0,0 +1,112 @@
+//
+// Compares the cost of shading a full screen drawFillRectangle with a per-pixel shader
+// (PXShader_t) against the equivalent span shader (SpanShader_t), and without a shader as a
+// baseline. Runs on the headless gfx backend so needs no display; build with 'make bench'.
+//
+// Both shaders darken every other row (a scanline effect) so must produce the same pixels;
+// the presented checksums of each are compared to check this.
+//
+// usage: span_shader_bench [fills]
+//
+
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include "pxr_gfx.h"
+#include "pxr_log.h"
+
+using namespace pxr;
+
+static constexpr Vector2i SCREEN_RESOLUTION {224, 256};
+static constexpr gfx::Color4u FILL_COLOR {200, 120, 40, 255};
+static constexpr int DEF_FILL_COUNT {2000};
+static constexpr int WARMUP_FILL_COUNT {50};
+
+static gfx::Color4u darkenPixel(gfx::Color4u inColor, int pxx, int pxy)
+{
+  if(pxy & 1){
+    inColor._r >>= 1;
+    inColor._g >>= 1;
+    inColor._b >>= 1;
+  }
+  return inColor;
+}
+
+static void darkenSpan(gfx::Color4u* colors, int count, int pxx, int pxy)
+{
+  if(!(pxy & 1))
+    return;
+  for(int i = 0; i < count; ++i){
+    colors[i]._r >>= 1;
+    colors[i]._g >>= 1;
+    colors[i]._b >>= 1;
+  }
+}
+
+struct BenchResult
+{
+  double _nanosPerFill;
+  uint64_t _checksum;
+};
+
+static BenchResult benchFills(gfx::ScreenId_t screenid, int fillCount)
+{
+  iRect rect {0, 0, SCREEN_RESOLUTION._x, SCREEN_RESOLUTION._y};
+
+  for(int i = 0; i < WARMUP_FILL_COUNT; ++i)
+    gfx::drawFillRectangle(rect, FILL_COLOR, screenid);
+
+  auto start = std::chrono::steady_clock::now();
+  for(int i = 0; i < fillCount; ++i)
+    gfx::drawFillRectangle(rect, FILL_COLOR, screenid);
+  auto end = std::chrono::steady_clock::now();
+
+  gfx::present();
+
+  BenchResult result;
+  result._nanosPerFill = std::chrono::duration<double, std::nano>(end - start).count() / fillCount;
+  result._checksum = gfx::getPresentStats()._checksum;
+  return result;
+}
+
+int main(int argc, char* argv[])
+{
+  int fillCount = (argc > 1) ? std::atoi(argv[1]) : DEF_FILL_COUNT;
+  if(fillCount <= 0)
+    fillCount = DEF_FILL_COUNT;
+
+  log::initialize();
+  if(!gfx::initialize("span_shader_bench", SCREEN_RESOLUTION, false, gfx::PresentMode::POINTS,
+                      gfx::Backend::HEADLESS)){
+    std::fprintf(stderr, "failed to initialize gfx; see log\n");
+    return EXIT_FAILURE;
+  }
+
+  gfx::ScreenId_t screenid = gfx::createScreen(SCREEN_RESOLUTION);
+
+  gfx::setScreenPixelMode(gfx::PixelMode::NO_SHADER, screenid);
+  BenchResult unshaded = benchFills(screenid, fillCount);
+
+  gfx::setScreenPixelMode(gfx::PixelMode::SHADER, screenid);
+  gfx::setPixelShader(darkenPixel, screenid);        // also removes any span shader.
+  BenchResult pixelShaded = benchFills(screenid, fillCount);
+
+  gfx::setSpanShader(darkenSpan, screenid);
+  BenchResult spanShaded = benchFills(screenid, fillCount);
+
+  gfx::shutdown();
+  log::shutdown();
+
+  std::printf("full screen drawFillRectangle %dx%d, %d fills\n", SCREEN_RESOLUTION._x, SCREEN_RESOLUTION._y, fillCount);
+  std::printf("  no shader      : %10.1f ns/fill\n", unshaded._nanosPerFill);
+  std::printf("  pixel shader   : %10.1f ns/fill\n", pixelShaded._nanosPerFill);
+  std::printf("  span shader    : %10.1f ns/fill (%.2fx pixel shader)\n", spanShaded._nanosPerFill,
+              pixelShaded._nanosPerFill / spanShaded._nanosPerFill);
+
+  if(pixelShaded._checksum != spanShaded._checksum){
+    std::printf("error: pixel and span shaded checksums differ\n");
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
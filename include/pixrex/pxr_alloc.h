@@ -0,0 +1,89 @@
+#ifndef _PIXIRETRO_ALLOC_H_
+#define _PIXIRETRO_ALLOC_H_
+
+#include <cstdint>
+
+namespace pxr
+{
+namespace alloc
+{
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// PIXIRETRO ALLOCATION TRACKER
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// This module replaces the global operator new and delete to count the heap allocations made
+// via new (and so by the std containers) by all threads. The engine samples the counts each
+// frame to show the allocations per frame on the stats screen.
+//
+// Allocations can also be forbidden on a thread for the lifetime of a ForbidScope, in which
+// case any allocation aborts the program; run in a debugger to find the allocating call.
+// Scopes nest, so an inner scope can allow allocations within a forbidding scope,
+//
+//      {
+//        alloc::ForbidScope forbid {};
+//        ...                                   // allocating aborts.
+//        {
+//          alloc::ForbidScope allow {false};
+//          ...                                 // allocating is fine.
+//        }
+//      }
+//
+// Allocations made with malloc directly, e.g. by SDL and opengl drivers, are not seen.
+//
+// The tracker is compiled only if PXR_ALLOC_TRACKING is defined (e.g. -DPXR_ALLOC_TRACKING);
+// otherwise the default operator new and delete are used, the counts are always 0 and scopes
+// do nothing.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+struct AllocStats
+{
+  int64_t _allocs;     // number of allocations since the program started.
+  int64_t _bytes;      // bytes requested by those allocations.
+};
+
+#ifdef PXR_ALLOC_TRACKING
+
+static constexpr bool isTracking {true};
+
+AllocStats getStats();
+
+//
+// Sets whether allocations are forbidden on the calling thread for its lifetime, restoring
+// the prior setting on destruction.
+//
+class ForbidScope
+{
+public:
+  explicit ForbidScope(bool isForbidding = true);
+  ~ForbidScope();
+  ForbidScope(const ForbidScope&) = delete;
+  ForbidScope& operator=(const ForbidScope&) = delete;
+
+private:
+  bool _wasForbidding;
+};
+
+#else
+
+static constexpr bool isTracking {false};
+
+inline AllocStats getStats(){return AllocStats{0, 0};}
+
+class ForbidScope
+{
+public:
+  explicit ForbidScope(bool isForbidding = true){}
+  ForbidScope(const ForbidScope&) = delete;
+  ForbidScope& operator=(const ForbidScope&) = delete;
+};
+
+#endif
+
+} // namespace alloc
+} // namespace pxr
+
+#endif
@@ -4,12 +4,24 @@
 #include <memory>
 #include <string>
 #include <unordered_map>
+#include <cassert>
+
+#include "pxr_triplebuffer.h"
 
 namespace pxr
 {
 
 class App;
 
+//
+// Base class for app state snapshots. A snapshot holds all the data an app state needs to draw
+// a frame; derive from this class to hold the draw data of your states. See App::hasSnapshots.
+//
+struct AppSnapshot
+{
+  virtual ~AppSnapshot() = default;
+};
+
 //
 // Virtual base class for app states. Derive from this class to create app 'modes'
 // that can be switched between, e.g. a splash screen, a menu, a gameplay state etc.
@@ -23,8 +35,39 @@ public:
   virtual bool onInit() = 0;
   virtual void onUpdate(double now, float dt) = 0;
   virtual void onDraw(double now, float dt, int screenid) = 0;
+
+  //
+  // Called in place of the above; override to draw with interpolation. 'alpha' is the fraction
+  // of the update tick period elapsed since the last update tick, in the range [0, 1]. Drawing
+  // moving objects at 'previous + (alpha * (current - previous))', where previous and current
+  // are the positions after the last 2 update ticks, draws motion smoothly when draw ticks are
+  // more frequent than update ticks (see drawFpsLock in the engine rc), at the cost of drawing
+  // a tick behind.
+  //
+  virtual void onDraw(double now, float dt, int screenid, float alpha)
+  {
+    onDraw(now, dt, screenid);
+  }
   virtual void onReset() = 0;
 
+  //
+  // Optional snapshot hooks; implement them in all states and override App::hasSnapshots to
+  // allow the engine to run update ticks on their own thread.
+  //
+  //    makeSnapshot   - returns a new (empty) snapshot of the derived snapshot type of the
+  //                     state. Called a few times per state, not every tick.
+  //
+  //    onSnapshot     - called on the update thread at the end of every update tick; must 
+  //                     write the draw data of the state into the snapshot, overwriting the 
+  //                     data of an older tick.
+  //
+  //    onDrawSnapshot - called on the main thread in place of onDraw; must draw from the 
+  //                     snapshot only as the state may be mid update.
+  //
+  virtual std::unique_ptr<AppSnapshot> makeSnapshot() {return nullptr;}
+  virtual void onSnapshot(AppSnapshot& snapshot) {}
+  virtual void onDrawSnapshot(const AppSnapshot& snapshot, double now, float dt, int screenid) {}
+
   virtual std::string getName() const = 0;
 
 protected:
@@ -65,11 +108,47 @@ public:
   //
   // Invoked by the engine during the draw tick.
   //
-  void onDraw(double now, float dt)
+  void onDraw(double now, float dt, float alpha)
   {
-    _active->onDraw(now, dt, _activeScreenid);
+    _active->onDraw(now, dt, _activeScreenid, alpha);
   }
 
+  //
+  // Invoked by the engine at the end of the update tick when update ticks run on their own 
+  // thread. Publishes a snapshot of the active state to the draw tick.
+  //
+  void onSnapshot()
+  {
+    SnapshotSlot& slot = _snapshots.getBack();
+    if(slot._state != _active.get()){
+      slot._snapshot = _active->makeSnapshot();
+      slot._state = _active.get();
+      assert(slot._snapshot != nullptr);   // else the state does not implement the snapshot hooks.
+    }
+    _active->onSnapshot(*slot._snapshot);
+    _snapshots.publish();
+  }
+
+  //
+  // Invoked by the engine during the draw tick, in place of onDraw, when update ticks run on
+  // their own thread. Draws the most recent snapshot.
+  //
+  void onDrawSnapshot(double now, float dt)
+  {
+    _snapshots.acquire();
+    const SnapshotSlot& slot = _snapshots.getFront();
+    if(slot._state != nullptr)
+      slot._state->onDrawSnapshot(*slot._snapshot, now, dt, _activeScreenid);
+  }
+
+  //
+  // Override to return true if all states of the app implement the snapshot hooks (see 
+  // AppState). The engine then runs update ticks on their own thread if enabled in the engine
+  // rc; a slow draw tick (e.g. a late vsync) then no longer delays update ticks. States must 
+  // not draw in onUpdate in this mode.
+  //
+  virtual bool hasSnapshots() const {return false;}
+
   //
   // For use by app states to switch between other states (game state, menu states etc).
   //
@@ -91,9 +170,22 @@ public:
   virtual int getVersionMinor() const = 0;
 
 protected:
+  //
+  // A snapshot and the state which wrote it; states are never destroyed whilst the app runs so
+  // the state can be kept as a plain pointer.
+  //
+  struct SnapshotSlot
+  {
+    AppState* _state {nullptr};
+    std::unique_ptr<AppSnapshot> _snapshot;
+  };
+
   std::unordered_map<std::string, std::shared_ptr<AppState>> _states;
   std::shared_ptr<AppState> _active;
   int _activeScreenid;
+
+private:
+  TripleBuffer<SnapshotSlot> _snapshots;
 };
 
 } // namespace pxr
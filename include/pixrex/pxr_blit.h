@@ -0,0 +1,66 @@
+#ifndef _PIXIRETRO_GFX_BLIT_H_
+#define _PIXIRETRO_GFX_BLIT_H_
+
+#include "pxr_color.h"
+
+namespace pxr
+{
+namespace gfx
+{
+
+//
+// The row kernels used by the gfx module to composite pixel spans onto screens. Each kernel
+// has a scalar implementation and, on x86, vectorised SSE2 and AVX2 implementations. The
+// kernel used is selected at runtime based on the features of the cpu; all implementations
+// produce bit-identical results.
+//
+// The kernels perform no clipping; callers must clip spans to the screen prior to the call.
+//
+
+//
+// The instruction sets a kernel can be implemented with.
+//
+enum class BlitKernel
+{
+  SCALAR,
+  SSE2,
+  AVX2
+};
+
+//
+// Selects the best kernel supported by the cpu. Called by the gfx module on initialization.
+//
+void initializeBlit();
+
+//
+// Forces the use of a specific kernel. If the cpu does not support the kernel requested the
+// best supported kernel is used instead. Useful to compare implementations.
+//
+void setBlitKernel(BlitKernel kernel);
+
+//
+// Provides access to the kernel in use.
+//
+BlitKernel getBlitKernel();
+
+//
+// Copies 'count' pixels from 'src' to 'dst' skipping all src pixels with alpha=0 (the alpha
+// key); the dst pixels corresponding to skipped src pixels are left unmodified.
+//
+void blitRowKeyed(Color4u* dst, const Color4u* src, int count);
+
+//
+// Sets 'count' pixels of 'dst' to 'color'. Any color fills at the same rate.
+//
+void blitRowFill(Color4u* dst, Color4u color, int count);
+
+//
+// Sets each of 'count' pixels of 'dst' to the color in the 256 entry 'palette' indexed by the
+// corresponding byte of 'src'.
+//
+void blitRowPalette(Color4u* dst, const uint8_t* src, const Color4u* palette, int count);
+
+} // namespace gfx
+} // namespace pxr
+
+#endif
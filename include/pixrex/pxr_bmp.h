@@ -2,6 +2,7 @@
 #define _PIXIRETRO_IO_BMPIMAGE_H_
 
 #include <fstream>
+#include <vector>
 #include "pxr_color.h"
 #include "pxr_vec.h"
 
@@ -32,10 +33,22 @@ public:
 
   void clear(gfx::Color4u color);
 
+  //
+  // Replaces the color of each pixel of an indexed image with the color of its index in 
+  // 'colors', which must hold 256 colors. Does nothing to images which are not indexed.
+  //
+  void mapIndices(const gfx::Color4u* colors);
+
   const gfx::Color4u getPixel(int row, int col);
   const gfx::Color4u* getRow(int row);
   const gfx::Color4u* const* getPixels() const {return _pixels;}
 
+  //
+  // True if the image was loaded from an indexed (1, 2, 4 or 8 bits per pixel) bmp, in which
+  // case the palette index of each pixel is kept alongside its color.
+  //
+  bool isIndexed() const {return !_indices.empty();}
+
   int getWidth() const {return _size._x;}
   int getHeight() const {return _size._y;}
   Vector2i getSize() const {return _size;}
@@ -119,6 +132,12 @@ private:
   // Size/dimensions of the bmp image: x=width (num cols) and y=height (num rows).
   //
   Vector2i _size;
+
+  //
+  // The palette index of each pixel of indexed images accessed [col + (row * width)]; empty
+  // for images which are not indexed.
+  //
+  std::vector<uint8_t> _indices;
 };
 
 } // namespace io
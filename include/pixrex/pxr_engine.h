@@ -2,15 +2,24 @@
 #define _PIXIRETRO_ENGINE_H_
 
 #include <SDL2/SDL_keycode.h>
+#include <SDL2/SDL_events.h>
 
 #include <memory>
 #include <chrono>
+#include <array>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <ctime>
 
 #include "pxr_rc.h"
 #include "pxr_app.h"
 #include "pxr_color.h"
 #include "pxr_gfx.h"
 #include "pxr_sfx.h"
+#include "pxr_alloc.h"
 
 namespace pxr
 {
@@ -50,16 +59,32 @@ private:
   using TimePoint_t = std::chrono::time_point<Clock_t>;
   using Duration_t = std::chrono::nanoseconds;
 
+  static constexpr Duration_t oneMicrosecond {1'000         };
   static constexpr Duration_t oneMillisecond {1'000'000     };
   static constexpr Duration_t oneSecond      {1'000'000'000 };
   static constexpr Duration_t oneHalfSecond  {500'000'000   };
   static constexpr Duration_t oneMinute      {60'000'000'000};
   static constexpr Duration_t minFramePeriod {1'000'000     };
+  static constexpr Duration_t idleWakePeriod {500'000'000   };   // max time blocked whilst idle.
+
+  //
+  // With the rc assertNoFrameAllocs set, the frames (and update ticks of the update thread) run
+  // after the splash which may allocate whilst caches, draw lists and queues grow to their
+  // steady state sizes; thereafter any allocation aborts (see alloc::ForbidScope).
+  //
+  static constexpr int allocWarmupFrames {300};
+
+  //
+  // The max key events queued to the update thread between its ticks; the queues are reserved
+  // when the thread starts and further events are dropped (and counted) rather than grown.
+  //
+  static constexpr int maxQueuedKeyEvents {256};
 
   static constexpr float splashDurationSeconds     {1.0f};
   static constexpr float splashWaitDurationSeconds {1.0f};
 
   static constexpr Vector2i statsScreenResolution {500, 200};
+  static constexpr iRect frameGraphBounds {10, 115, 480, 75};
   static constexpr Vector2i pauseScreenResolution {100, 60};
 
   //
@@ -76,6 +101,7 @@ private:
   static constexpr int resetGameClockScaleKey     {SDLK_KP_HASH     };
   static constexpr int pauseGameClockKey          {SDLK_p           };
   static constexpr int toggleDrawEngineStatsKey   {SDLK_BACKQUOTE   };
+  static constexpr int writeProfileTraceKey       {SDLK_F9          };    // only if built with PXR_PROFILE.
   static constexpr int skipSplashKey              {SDLK_ESCAPE      };
 
   //
@@ -101,6 +127,7 @@ private:
     void reset(){_now = _start = Clock_t::now();}
     Duration_t update();
     Duration_t getNow() {return _now - _start;}
+    TimePoint_t getNowTimePoint() const {return _now;}
   private:
     TimePoint_t _start;
     TimePoint_t _now;
@@ -124,6 +151,7 @@ private:
     void unpause(){_isPaused = false;}
     void togglePause(){_isPaused = !_isPaused;}
     bool isPaused() const {return _isPaused;}
+    bool toRealDuration(Duration_t gameDuration, Duration_t& realDuration) const;
   private:
     Duration_t _now;
     float _scale;
@@ -165,9 +193,14 @@ private:
     Ticker(Callback_t onTick, Engine* tickCtx, Duration_t tickPeriod, int maxTicksPerFrame, bool isChasingGameNow);
     void doTicks(Duration_t gameNow, Duration_t realNow);
     void reset();
+    void skipBacklog(Duration_t gameNow, Duration_t realNow);
     int getTicksDoneTotal() const {return _ticksDoneTotal;}
     int getTicksDoneThisFrame() const {return _ticksDoneThisFrame;}
     int getTicksAccumulated() const {return _ticksAccumulated;}
+    float getTickAlpha() const {return _tickAlpha;}
+    Duration_t getTickPeriod() const {return _tickPeriod;}
+    float getTickPeriodSeconds() const {return _tickPeriodSeconds;}
+    Duration_t getTimeToNextTick(Duration_t now) const;
     const std::array<double, FPS_HISTORY_SIZE>& getTickFrequencyHistory() {return _measuredTickFrequencyHistory;}
     bool isNewTickFrequencySample() const {return _isNewTickFrequencySample;}
     void setCallback(Callback_t onTick){_onTick = onTick;}
@@ -186,6 +219,12 @@ private:
     int _ticksAccumulated;             // backlog of ticks that need to be done.
     bool _isChasingGameNow;            // ticker either 'chases' the real clock or the game clock.
 
+    //
+    // The fraction of the tick period elapsed between the last tick done and the time of the 
+    // last call to 'doTicks', in the range [0, 1]. Used to interpolate draws between update ticks.
+    //
+    float _tickAlpha;
+
     //
     // Recorded history of samples for ticks per second (analagous to FPS but for ticks). Only 
     // storing the last FPS_HISTORY_SIZE samples with earlier samples being discarded.
@@ -199,6 +238,118 @@ private:
     bool _isNewTickFrequencySample;
   };
 
+  //
+  // Waits for deadlines with less jitter than a plain sleep. OS sleeps can wake late by up to a
+  // scheduler quantum (often a millisecond or more) so the pacer sleeps until a margin before
+  // the deadline then spins on the clock until the deadline. A larger margin thus trades cpu 
+  // time for lower jitter; a zero margin only sleeps.
+  //
+  // The pacer measures the wake error of each wait (the lateness of the wake w.r.t the 
+  // deadline) and the oversleep of each sleep (the lateness of the wake from the sleep w.r.t
+  // the end of the sleep, i.e. before spinning). The wake error shows the jitter the pacer 
+  // achieves whilst the oversleep shows the margin needed to achieve it: sleeps which 
+  // oversleep by more than the margin wake after the deadline. The stats accumulate until
+  // reset.
+  //
+  class FramePacer
+  {
+  public:
+    FramePacer() : _spinMargin{0}, _wakeErrorSum{0}, _wakeErrorMax{0}, _wakeCount{0},
+                   _oversleepSum{0}, _oversleepMax{0}, _sleepCount{0}, _lateSleepCount{0}{}
+    void setSpinMargin(Duration_t margin){_spinMargin = margin;}
+    Duration_t getSpinMargin() const {return _spinMargin;}
+    void waitUntil(TimePoint_t deadline);
+    Duration_t getMeanWakeError() const;
+    Duration_t getMaxWakeError() const {return _wakeErrorMax;}
+    Duration_t getMeanOversleep() const;
+    Duration_t getMaxOversleep() const {return _oversleepMax;}
+    int getSleepCount() const {return _sleepCount;}
+    int getLateSleepCount() const {return _lateSleepCount;}  // sleeps which woke after the deadline.
+    void resetWakeStats();
+  private:
+    Duration_t _spinMargin;
+    Duration_t _wakeErrorSum;
+    Duration_t _wakeErrorMax;
+    int _wakeCount;
+    Duration_t _oversleepSum;
+    Duration_t _oversleepMax;
+    int _sleepCount;
+    int _lateSleepCount;
+  };
+
+  //
+  // The stages of a frame which are timed. A frame ends with each draw tick (i.e. each present);
+  // the wall time of a frame is the real time since the end of the previous frame.
+  //
+  enum FrameStage
+  {
+    FRAME_STAGE_WALL,
+    FRAME_STAGE_UPDATE,
+    FRAME_STAGE_DRAW,
+    FRAME_STAGE_PRESENT,
+    FRAME_STAGE_COUNT
+  };
+
+  //
+  // The durations of the stages of a frame, indexed by FrameStage. The draw stage excludes the
+  // present and the update stage includes all update ticks done during the frame.
+  //
+  using FrameSample_t = std::array<Duration_t, FRAME_STAGE_COUNT>;
+
+  struct FramePercentiles
+  {
+    Duration_t _p50;
+    Duration_t _p95;
+    Duration_t _p99;
+    Duration_t _max;
+  };
+
+  //
+  // A fixed size ring of the most recent frame samples with rolling percentiles of each stage.
+  //
+  // The ring is written by a single thread and can be read by any thread without locks; samples
+  // are stored in atomics and published by advancing the head, and a reader which finds the 
+  // head has advanced past its sample while reading it discards the sample (see getSample).
+  //
+  // Percentiles are kept incrementally: each stage has a histogram of the samples in the ring
+  // which is updated as samples enter and leave, so a query is a walk of the histogram rather
+  // than a sort of the ring. Percentiles are thus quantised to the histogram bucket width and 
+  // saturate at the histogram range; the max is exact. Percentiles may only be queried by the 
+  // writing thread.
+  //
+  class FrameHistory
+  {
+  public:
+    static constexpr int FRAME_HISTORY_SIZE {512};
+    static constexpr Duration_t BUCKET_WIDTH {100'000};        // 0.1ms.
+    static constexpr int BUCKET_COUNT {1000};                  // thus a range of 100ms.
+
+  public:
+    FrameHistory();
+    void record(const FrameSample_t& sample);
+    void reset();
+
+    //
+    // Reads the sample recorded 'age' frames ago (0 being the most recent). Returns false if
+    // no such sample is held, including if it was overwritten during the read.
+    //
+    bool getSample(int age, FrameSample_t& sample) const;
+
+    int getSampleCount() const;
+    FramePercentiles getPercentiles(FrameStage stage) const;
+
+  private:
+    int toBucket(Duration_t d) const;
+    Duration_t findMax(FrameStage stage) const;
+
+  private:
+    std::array<std::array<std::atomic<int64_t>, FRAME_STAGE_COUNT>, FRAME_HISTORY_SIZE> _samples;
+    std::atomic<int64_t> _writesBegun;
+    std::atomic<int64_t> _writesDone;  // count of samples recorded; next slot = done % size.
+    std::array<std::array<int, BUCKET_COUNT>, FRAME_STAGE_COUNT> _histograms;
+    std::array<Duration_t, FRAME_STAGE_COUNT> _maxes;
+  };
+
   class EngineRC final : public io::RC
   {
   public:
@@ -212,7 +363,18 @@ private:
       KEY_CLEAR_RED,
       KEY_CLEAR_GREEN,
       KEY_CLEAR_BLUE,
-      KEY_FPS_LOCK
+      KEY_FPS_LOCK,
+      KEY_DRAW_FPS_LOCK,
+      KEY_PRESENT_MODE,
+      KEY_RASTER_THREADS,
+      KEY_GFX_BACKEND,
+      KEY_THREADED_UPDATE,
+      KEY_PACER_SPIN_MARGIN,
+      KEY_FAST_FORWARD_TICKS,
+      KEY_FAST_FORWARD_DRAW_EVERY,
+      KEY_INPUT_REPLAY,
+      KEY_ASSERT_NO_FRAME_ALLOCS,
+      KEY_JOB_WORKERS
     };
 
     EngineRC() : RC({
@@ -223,14 +385,44 @@ private:
       {KEY_CLEAR_RED,     "clearRed",     {10},    {0},     {255}},
       {KEY_CLEAR_GREEN,   "clearGreen",   {10},    {0},     {255}},
       {KEY_CLEAR_BLUE,    "clearBlue",    {10},    {0},     {255}},
-      {KEY_FPS_LOCK,      "fpsLock",      {60},    {24},    {1000}}
+      {KEY_FPS_LOCK,      "fpsLock",      {60},    {24},    {1000}},
+      {KEY_DRAW_FPS_LOCK, "drawFpsLock",  {0},     {0},     {1000}},  // 0=fpsLock; draws are interpolated.
+      {KEY_PRESENT_MODE,  "presentMode",  {1},     {0},     {2}},     // 0=points 1=texture 2=composite
+      {KEY_RASTER_THREADS,"rasterThreads",{4},     {1},     {64}},    // max job workers rasterising deferred screens and composites.
+      {KEY_GFX_BACKEND,   "gfxBackend",   {0},     {0},     {1}},     // 0=opengl 1=headless
+      {KEY_THREADED_UPDATE,"threadedUpdate",{false},{false}, {true}},   // only if the app has snapshots.
+      {KEY_PACER_SPIN_MARGIN,"pacerSpinMargin",{1000},{0},   {20000}}, // microseconds spun before each tick.
+      {KEY_FAST_FORWARD_TICKS,"fastForwardTicks",{0},{0},   {1000000000}}, // 0=off; see fastForward.
+      {KEY_FAST_FORWARD_DRAW_EVERY,"fastForwardDrawEvery",{0},{0},{1000000}}, // 0=never draw.
+      {KEY_INPUT_REPLAY,  "inputReplay",  {0},     {0},     {2}},     // 0=off 1=record 2=replay
+      {KEY_ASSERT_NO_FRAME_ALLOCS,"assertNoFrameAllocs",{false},{false},{true}}, // only if built with PXR_ALLOC_TRACKING.
+      {KEY_JOB_WORKERS,   "jobWorkers",   {4},     {1},     {64}}     // includes the main thread.
     }){}
   };
 
 private:
+  gfx::Backend selectGfxBackend();
   void mainloop();
+  void onEvent(const SDL_Event& event);
+  void updateIdle();
+  void idle();
+  bool measureCpuUsage(Duration_t realNow);
+  void fastForward();
+  void startInputReplay();
+  void stopInputReplay();
+  void updateLoop();
+  void startUpdateThread();
+  void stopUpdateThread();
+  TimePoint_t updateClocks(Duration_t& gameNow, Duration_t& realNow);
+  void readClocks(Duration_t& gameNow, Duration_t& realNow);
+  Duration_t getTimeToNextUpdateTick(Duration_t gameNow);
+  void forwardKeyEvent(const SDL_Event& event);
+  void applyKeyEvents();
   void drawEngineStats();
+  void drawFrameGraph();
   void drawPauseDialog();
+  void present();
+  void recordFrame(Duration_t drawTime);
   void onUpdateTick(float tickPeriodSeconds);
   void onDrawTick(float tickPeriodSeconds);
 
@@ -253,6 +445,31 @@ private:
   RealClock _realClock;
   GameClock _gameClock;
 
+  //
+  // With a threaded update the update ticks run on _updateThread and draw from snapshots (see 
+  // App::hasSnapshots). Both threads advance the clocks so the clocks are guarded by 
+  // _clockMutex, and key events are queued to the update thread so the input module is only 
+  // accessed from the update thread.
+  //
+  bool _isUpdateThreaded;
+  std::thread _updateThread;
+  std::atomic<bool> _isUpdateThreadStopping;
+  std::mutex _clockMutex;
+  std::mutex _keyEventsMutex;
+  std::vector<SDL_Event> _pendingKeyEvents;
+  std::vector<SDL_Event> _keyEvents;
+  int _droppedKeyEvents;
+
+  //
+  // Whilst idle (see updateIdle) the mainloop blocks on events and the update thread blocks on
+  // _idleWake. _needIdleRedraw marks the window as needing a redraw whilst idle.
+  //
+  bool _isWindowFocused;
+  std::atomic<bool> _isIdle;
+  bool _needIdleRedraw;
+  std::mutex _idleMutex;
+  std::condition_variable _idleWake;
+
   gfx::Color4f _clearColor;
 
   int _fpsLockHz;
@@ -262,6 +479,26 @@ private:
   float _measuredFrameFrequency;
   Duration_t _lastFrameMeasureNow;
 
+  Duration_t _lastCpuMeasureNow;
+  std::clock_t _lastCpuClock;
+  float _measuredCpuUsage;             // percent of one core used by all threads.
+
+  FrameHistory _frameHistory;
+  TimePoint_t _lastFrameEnd;
+
+  FramePacer _pacer;
+  FramePacer _updatePacer;             // the update thread has its own pacer.
+
+  Duration_t _frameUpdateTime;         // update time accumulated since the last frame ended.
+  Duration_t _framePresentTime;        // time of the last present.
+  Duration_t _targetFramePeriod;
+
+  alloc::AllocStats _lastFrameAllocStats;
+  int64_t _maxFrameAllocs;             // max allocations of a frame since the stats were drawn.
+  int64_t _maxFrameAllocBytes;
+  bool _isAssertingNoFrameAllocs;
+  long _allocWarmupEndFrame;
+
   int _statsScreenId;
   int _pauseScreenId;
 
@@ -278,6 +515,7 @@ private:
 
   bool _isDrawingEngineStats;
   bool _needRedrawEngineStats;
+  bool _isFastForwarding;
   bool _isDone;
 };
 
@@ -2,6 +2,10 @@
 #define _PIXIRETRO_GFX_H_
 
 #include <string>
+#include <string_view>
+#include <array>
+#include <vector>
+#include <cstdint>
 #include <cmath>
 
 #include "pxr_color.h"
@@ -19,6 +23,7 @@ namespace gfx
 //
 constexpr const char* RESOURCE_PATH_SPRITESHEETS = "assets/spritesheets/";
 constexpr const char* RESOURCE_PATH_FONTS = "assets/fonts/";
+constexpr const char* RESOURCE_PATH_SPRITEMASKS = "assets/bitmaps/";
 
 //
 // The file extensions for the resource's xml meta files.
@@ -26,6 +31,11 @@ constexpr const char* RESOURCE_PATH_FONTS = "assets/fonts/";
 constexpr const char* XML_RESOURCE_EXTENSION_SPRITESHEETS = ".spritesheet";
 constexpr const char* XML_RESOURCE_EXTENSION_FONTS = ".font";
 
+//
+// The file extension of sprite mask files; masks have no xml meta file.
+//
+constexpr const char* RESOURCE_EXTENSION_SPRITEMASKS = ".bitmap";
+
 //
 // A unique key to identify a gfx resource for use in draw calls.
 //
@@ -71,6 +81,7 @@ struct Font
   int _lineHeight;
   int _baseLine;
   int _glyphSpace;
+  bool _isPalette {false};   // loaded for PALETTE8 screens; see loadFont.
 };
 
 //
@@ -117,15 +128,123 @@ struct Sprite
 //
 using SpriteId_t = int;
 
+//
+// The ways a sprite can be mirrored when drawn. Used to index the pre-baked runs of a sprite.
+//
+enum SpriteMirror
+{
+  MIRROR_NONE,
+  MIRROR_X,
+  MIRROR_Y,
+  MIRROR_XY,
+  MIRROR_COUNT
+};
+
+//
+// A horizontal run of opaque (alpha!=0) pixels in a row of a sprite.
+//
+struct SpriteRun
+{
+  int _col;      // column of the first pixel of the run w.r.t the sprite.
+  int _length;   // number of pixels in the run.
+  int _pixels;   // index of the first pixel of the run in Spritesheet::_runPixels.
+};
+
+//
+// The range of runs [_begin, _end) in Spritesheet::_runs which make up a row of a sprite.
+//
+struct SpriteRunRow
+{
+  int _begin;
+  int _end;
+};
+
 //
 // A spritesheet organises a bitmap image into sprites.
 //
+// Upon load the opaque pixels of each sprite are compiled into runs for each mirror variant 
+// so draws can copy whole runs without testing the alpha of each pixel, and so mirrored draws 
+// cost the same as unmirrored draws. The runs of row r of sprite s drawn with mirror m are,
+//
+//      _runRows[_spriteRunRows[(s * MIRROR_COUNT) + m] + r]
+//
+// The pixels of runs are stored in _runPixels (already reversed for x-mirrored variants) and
+// referenced by index so sheets remain copyable. Sheets loaded for PALETTE8 screens (see 
+// loadSpritesheet) also hold the palette index of each of the _runPixels in _runIndices; 
+// otherwise _runIndices is empty.
+//
 struct Spritesheet
 {
   io::Bmp _image;
   std::vector<Sprite> _sprites;
+  std::vector<int> _spriteRunRows;
+  std::vector<SpriteRunRow> _runRows;
+  std::vector<SpriteRun> _runs;
+  std::vector<Color4u> _runPixels;
+  std::vector<uint8_t> _runIndices;
+  bool _isPalette {false};
+};
+
+//
+// A sprite mask is a 1-bit image; set bits are drawn in the tint color of the draw call and
+// clear bits are transparent. Masks cost an eighth of the memory of a sprite per pixel and
+// can be drawn in any color, e.g. the single color invaders of the arcade original.
+//
+// Each row is packed into _wordsPerRow 64-bit words with column c in bit (c % 64) of word 
+// (c / 64); bits beyond the width of the mask are always clear. Rows are stored bottom row
+// first (as screens are) so the bits of row r are,
+//
+//      _words[(r * _wordsPerRow) + (c / 64)]
+//
+struct SpriteMask
+{
+  Vector2i _size;
+  int _wordsPerRow;
+  std::vector<uint64_t> _words;
 };
 
+//
+// The color mode sets how the pixels of a screen are stored.
+//
+// The modes apply as follows:
+//
+//      FULL_RGB - the default. Each pixel is stored as a Color4u; draw calls write their 
+//                 colors as is.
+//
+//      PALETTE8 - Each pixel is stored as a single byte index into the 256 color palette of
+//                 the screen (see setScreenPalette); index 0 (PALETTE_KEY) is transparent. 
+//                 Draw calls take palette indices via their PaletteIndex_t variants (or, to
+//                 clear, clearScreenTransparent). Passing a Color4u to a PALETTE8 screen is a
+//                 misuse which asserts (and is dropped in release builds), as is drawing 
+//                 sprites and text from spritesheets and fonts not loaded for PALETTE8 
+//                 screens (see loadSpritesheet). Only the indices are stored; colors are 
+//                 looked up in the palette on the gpu in PresentMode::TEXTURE, so swapping 
+//                 the palette uploads only the 256 entry palette rather than the screen. 
+//                 Pixel shaders are not applied to palette screens.
+//
+enum class ColorMode
+{
+  FULL_RGB,
+  PALETTE8
+};
+
+using PaletteIndex_t = uint8_t;
+
+constexpr int PALETTE_SIZE {256};
+constexpr PaletteIndex_t PALETTE_KEY {0};
+
+using Palette_t = std::array<Color4u, PALETTE_SIZE>;
+
+//
+// The default color of a palette index: the grey with all channels set to the index. Index
+// draws to FULL_RGB screens, and sprites and text from palette resources drawn to FULL_RGB
+// screens, are drawn in these colors.
+//
+constexpr Color4u paletteColor(PaletteIndex_t index)
+{
+  return Color4u{index, index, index, static_cast<uint8_t>(index == PALETTE_KEY ? 0 : 255)};
+}
+
 //
 // The pixel mode sets whether to use a pixel shader in draw calls.
 //
@@ -135,7 +254,8 @@ struct Spritesheet
 //                  an explicit color arg or the gfx resource).
 //
 //      SHADER    - Pixel colors are fed into a user provided shader function along with the
-//                  pixel coordinate. The output color is then drawn to the screen.
+//                  pixel coordinate. The output color is then drawn to the screen. The shader
+//                  is either a pixel shader or a span shader (see below).
 //
 enum class PixelMode
 {
@@ -143,6 +263,26 @@ enum class PixelMode
   SHADER
 };
 
+//
+// The draw mode controls when the draw calls to a screen are rasterised.
+//
+// The modes apply as follows:
+//
+//      IMMEDIATE - the default. Draw calls rasterise to the screen before returning.
+//
+//      DEFERRED  - Draw calls append commands to a command list of the screen which is 
+//                  rasterised by present. The screen is split into tiles (bands of rows)
+//                  which are shared between the raster threads (see setRasterThreadCount),
+//                  with the commands executed in draw call order within each tile. The 
+//                  output is identical to immediate mode. Shaders used with deferred screens
+//                  must be safe to call concurrently.
+//
+enum class DrawMode
+{
+  IMMEDIATE,
+  DEFERRED
+};
+
 //
 // The size mode controls the size of the pixels of a screen. Minimum pixel size is 1, the
 // maximum size is determined by the opengl implementation used (max is printed to the log
@@ -195,6 +335,36 @@ enum class PositionMode
   BOTTOM_RIGHT
 };
 
+//
+// The present mode controls how the results of draw calls are handed to opengl and rendered
+// to the window. The mode is chosen once upon initialization and applies to all screens.
+//
+// The modes apply as follows:
+//
+//      POINTS  - every virtual pixel of every screen is submitted as an opengl point of
+//                diameter _pxSize. Requires nothing beyond opengl 2.1 but cost scales with
+//                the number of virtual pixels.
+//
+//      TEXTURE - each screen is streamed into a texture via a pair of pixel buffer objects
+//                and drawn as a single nearest-filtered quad scaled by _pxSize. Requires
+//                opengl 2.1 or GL_ARB_pixel_buffer_object, and glsl (opengl 2.0) to look up
+//                the colors of PALETTE8 screens; if the context lacks them gfx falls back to
+//                POINTS mode. The default mode.
+//
+//      COMPOSITE - the enabled screens are scaled by _pxSize and merged (with the alpha key)
+//                  into a single window sized buffer on the cpu, sharing the rows between the
+//                  raster threads, which is then streamed and drawn as in TEXTURE mode. The 
+//                  window thus needs a single upload and draw however many screens are 
+//                  stacked. The composite is only rebuilt if a screen is dirty or the layout of
+//                  the screens changed. Requires the same functions as TEXTURE mode.
+//
+enum class PresentMode
+{
+  POINTS,
+  TEXTURE,
+  COMPOSITE
+};
+
 //
 // The signiture of pixel shader functions to be set by the user if using PixelMode::SHADER.
 //
@@ -214,6 +384,28 @@ enum class PositionMode
 //
 using PXShader_t = Color4u (*)(Color4u inColor, int pxx, int pxy);
 
+//
+// The signiture of span shader functions; an alternative to pixel shaders which shades a whole 
+// horizontal row of pixels in one call, avoiding the cost of an indirect call per pixel and 
+// allowing the shader to be vectorised.
+//
+// The arguments to the shader are:
+//
+//    colors  - the 'count' colors to shade in place. colors[i] is the pixel at [pxx + i, pxy].
+//
+//    count   - the number of pixels in the span.
+//
+//    pxx     - the x-axis position of the first pixel in the span w.r.t the virtual screen
+//              coordinate space.
+//
+//    pxy     - the y-axis position of the span w.r.t the virtual screen coordinate space.
+//
+// Spans are taken from the opaque runs of clipped sprites and text strings and the rows of 
+// rectangles. Draws which do not produce horizontal runs (lines, points, sprite columns) are
+// shaded as spans of length 1.
+//
+using SpanShader_t = void (*)(Color4u* colors, int count, int pxx, int pxy);
+
 //
 // A virtual screen of virtual pixels used to create a layer of abstraction from the display
 // allowing extra properties to be added to the screen such as a fixed resolution independent
@@ -240,20 +432,37 @@ using PXShader_t = Color4u (*)(Color4u inColor, int pxx, int pxy);
 // transparent pixels in a screen will allow the corresponding pixel of any screens lower in the 
 // stacking order to show through.
 //
+// Each screen tracks the region of pixels written by draw calls since it was last presented,
+// its dirty region. In PresentMode::TEXTURE clean screens are not uploaded and dirty screens
+// upload only their dirty region.
+//
 struct Screen
 {
   PXShader_t   _pxShader;
+  SpanShader_t _spanShader;      // if not null, used in place of _pxShader.
   PositionMode _pmode;
   SizeMode     _smode;
   PixelMode    _xmode;
+  DrawMode     _dmode;
+  ColorMode    _cmode;
   Vector2i     _position;        // position w.r.t window space.
   Vector2i     _manualPosition;  // position w.r.t window space when in manual position mode.
   Vector2i     _resolution;      // size/dimensions of the virtual screen.
   int          _pxSize;          // size of virtual pixels (unit: real pixels).
   int          _pxManualSize;    // size of virtual pixels when in manual size mode.
   int          _pxCount;         // total number of virtual pixels on the screen.
-  Color4u*     _pxColors;        // accessed [col + (row * width)]
+  Color4u*     _pxColors;        // accessed [col + (row * width)]; FULL_RGB only, else null.
+  uint8_t*     _pxIndices;       // accessed [col + (row * width)]; PALETTE8 only, else null.
+  Palette_t    _palette;         // PALETTE8 only.
+  bool         _isPaletteStale;  // has the palette changed since last uploaded to _glPaletteTexture?
   Vector2i*    _pxPositions;     // accessed [col + (row * width)]
+  unsigned     _glTexture;       // texture streamed to in PresentMode::TEXTURE.
+  unsigned     _glPaletteTexture;// PALETTE8 only; the palette as a 256x1 texture.
+  unsigned     _glPbos[2];       // pixel buffer objects alternated between uploads.
+  int          _pboIndex;        // index of the pbo used in the last upload.
+  Vector2i     _dirtyMin;        // bottom-left pixel of the dirty region (inclusive).
+  Vector2i     _dirtyMax;        // top-right pixel of the dirty region (inclusive).
+  bool         _isDirty;         // has any pixel been written since the last present?
   bool         _isEnabled;       // enable/disable drawing this screen to the window.
 };
 
@@ -262,10 +471,60 @@ struct Screen
 //
 using ScreenId_t = int;
 
+//
+// Statistics gathered by the last call to present; useful to gauge how much upload bandwidth
+// dirty region tracking is saving.
+//
+struct PresentStats
+{
+  int _screensPresented;  // number of enabled screens drawn to the window.
+  int _screensUploaded;   // number of screens whose pixels were sent to opengl.
+  int _pxPresented;       // total virtual pixels of all screens drawn.
+  int _pxDirty;           // total virtual pixels within the dirty regions of all screens drawn.
+  int _pxUploaded;        // total virtual pixels sent to opengl.
+  uint64_t _checksum;     // Backend::HEADLESS only; hash of the pixels of all screens drawn
+                          // (of the composite in PresentMode::COMPOSITE).
+  int64_t _presentNanos;  // wall time spent in present, including deferred rasterisation.
+};
+
+//
+// The backend controls where screens are presented.
+//
+// The backends apply as follows:
+//
+//      OPENGL   - the default. Screens are presented to a window via opengl using the 
+//                 present mode.
+//
+//      HEADLESS - No window or opengl context is created; screens exist only in memory. 
+//                 Present checksums the enabled screens instead of drawing them, allowing
+//                 the rasteriser to be tested and benchmarked without a display. The only
+//                 present mode supported is COMPOSITE (which needs no opengl to build the
+//                 composite); all other modes are replaced with POINTS.
+//
+enum class Backend
+{
+  OPENGL,
+  HEADLESS
+};
+
 //
 // Initializes the gfx subsystem. Returns true if success and false if fatal error.
 //
-bool initialize(std::string windowTitle, Vector2i windowSize, bool fullscreen);
+// The present mode requested may not be the mode used if the opengl implementation does
+// not support it; use getPresentMode to query the mode in use.
+//
+bool initialize(std::string windowTitle, Vector2i windowSize, bool fullscreen,
+                PresentMode presentMode = PresentMode::TEXTURE, Backend backend = Backend::OPENGL);
+
+//
+// Provides access to the present mode in use.
+//
+PresentMode getPresentMode();
+
+//
+// Provides access to the backend in use.
+//
+Backend getBackend();
 
 //
 // Call to shutdown the module upon app termination.
@@ -284,7 +543,10 @@ void shutdown();
 // Returns the integer id of the screen for use with draw calls. Internally screens are stored
 // in an array thus returned ids start at 0 and increase by 1 with each new screen created.
 //
-int createScreen(Vector2i resolution);
+// The color mode of a screen is fixed at creation. PALETTE8 screens are created with the 
+// palette of greys (index i is paletteColor(i)).
+//
+int createScreen(Vector2i resolution, ColorMode colorMode = ColorMode::FULL_RGB);
 
 //
 // Must be called whenever the window resizes to update the screens.
@@ -308,7 +570,13 @@ void onWindowResize(Vector2i windowSize);
 // without duplication, each time returning the same key. To actually remove a spritesheet from
 // memory it is necessary to unload a spritesheet an equal number of times to which it was loaded.
 //
-ResourceKey_t loadSpritesheet(ResourceName_t name);
+// Sheets drawn to PALETTE8 screens must be loaded with 'colorMode' PALETTE8 and their bmp must
+// be indexed (8 bits per pixel or fewer); the bmp's index of each pixel is drawn as is and index
+// 0 (PALETTE_KEY) is transparent, whatever the colors of the bmp's palette. Sheets which are not
+// indexed are rejected, substituting the error spritesheet. A sheet loaded in both modes is 
+// held once per mode.
+//
+ResourceKey_t loadSpritesheet(ResourceName_t name, ColorMode colorMode = ColorMode::FULL_RGB);
 
 //
 // Unloads a spritesheet. The spritesheet will only be removed from memory if the reference 
@@ -332,7 +600,11 @@ void unloadSpritesheet(ResourceKey_t sheetKey);
 // without duplication, each time returning the same key. To actually remove a fonts from
 // memory it is necessary to unload a fonts an equal number of times to which it was loaded.
 //
-ResourceKey_t loadFont(ResourceName_t name);
+// Fonts drawn to PALETTE8 screens must be loaded with 'colorMode' PALETTE8; as for 
+// spritesheets (see loadSpritesheet) their bmp must be indexed, else the error font is 
+// substituted.
+//
+ResourceKey_t loadFont(ResourceName_t name, ColorMode colorMode = ColorMode::FULL_RGB);
 
 //
 // Unloads a font. The font will only be removed from memory if the reference count drops 
@@ -340,6 +612,24 @@ ResourceKey_t loadFont(ResourceName_t name);
 //
 void unloadFont(ResourceKey_t fontKey);
 
+//
+// Loads a sprite mask from RESOURCE_PATH_SPRITEMASKS directory in the file system.
+//
+// The 'name' arg must be the name of the mask file (see RESOURCE_EXTENSION_SPRITEMASKS). Mask 
+// files are text files with a line of '0' and '1' chars for each row of the mask, top row 
+// first; '1' marks a set bit. All rows must be the same length; trailing whitespace is ignored.
+//
+// Returns the resource key the loaded mask was mapped to. Masks are reference counted as 
+// spritesheets are (see loadSpritesheet).
+//
+ResourceKey_t loadSpriteMask(ResourceName_t name);
+
+//
+// Unloads a sprite mask. The mask will only be removed from memory if the reference count 
+// drops to zero.
+//
+void unloadSpriteMask(ResourceKey_t maskKey);
+
 //
 // Provides access to the sprite count of a spritesheet.
 //
@@ -351,7 +641,7 @@ int getSpriteCount(ResourceKey_t sheetKey);
 void clearWindowColor(Color4f color);
 
 //
-// Clears a screen to full transparency.
+// Clears a screen to full transparency. Valid for screens of either color mode.
 //
 void clearScreenTransparent(ScreenId_t screenid);
 
@@ -367,8 +657,8 @@ void clearScreenShade(int shade, ScreenId_t screenid);
 //
 // Clears a screen with a solid color. 
 //
-// note: this is a slow operation to be used only if you really need a specific color. For 
-// simple clearing ops use 'fillScreenShade'. 
+// note: clears fill whole registers of pixels at a time so run at the same speed for any
+// color; there is no need to prefer 'clearScreenShade'.
 //
 void clearScreenColor(Color4u color, ScreenId_t screenid);
 
@@ -384,10 +674,18 @@ void drawSprite(Vector2i position, ResourceKey_t sheetKey, SpriteId_t spriteid,
 //
 void drawSpriteColumn(Vector2i position, ResourceKey_t sheetKey, SpriteId_t spriteid, int colid, ScreenId_t screenid);
 
+//
+// Draw a sprite mask with its bottom-left pixel at position. The set bits of the mask are 
+// drawn in the tint color.
+//
+void drawSpriteMask(Vector2i position, ResourceKey_t maskKey, Color4u tint, ScreenId_t screenid);
+
 // 
-// Draw a text string.
+// Draw a text string. Strings are composited into opaque runs on first draw and cached thus
+// redrawing a string costs the same as drawing a sprite; the least recently drawn strings are 
+// evicted when the cache is full.
 //
-void drawText(Vector2i position, const std::string& text, ResourceKey_t fontKey, ScreenId_t screenid);
+void drawText(Vector2i position, std::string_view text, ResourceKey_t fontKey, ScreenId_t screenid);
 
 //
 // Draw a border rectangle, i.e draw only the outline. This function clamps the rectangle to 
@@ -401,25 +699,81 @@ void drawBorderRectangle(iRect rect, Color4u color, ScreenId_t screenid);
 void drawFillRectangle(iRect rect, Color4u color, ScreenId_t screenid);
 
 //
-// Draw a line.
+// Draws 'count' fill rectangles of the same color; equivalent to calling drawFillRectangle for
+// each but amortises the per call overhead.
+//
+void drawFillRectangles(const iRect* rects, int count, Color4u color, ScreenId_t screenid);
+
+//
+// Draw a line. Both end points are drawn. Lines which leave the screen are clipped to it (not
+// clamped) so the visible part of the line keeps its slope.
 //
 void drawLine(Vector2i p0, Vector2i p1, Color4u color, ScreenId_t screenid);
 
+//
+// Draws 'lineCount' lines of the same color from consecutive pairs of end points, i.e. the
+// lines [endPoints[0], endPoints[1]], [endPoints[2], endPoints[3]] etc. Equivalent to calling
+// drawLine for each but amortises the per call overhead.
+//
+void drawLines(const Vector2i* endPoints, int lineCount, Color4u color, ScreenId_t screenid);
+
+//
+// Draws lines connecting each point to the next; if closed the last point is also connected to
+// the first, e.g. to outline a polygon.
+//
+void drawPolyline(const Vector2i* points, int pointCount, Color4u color, ScreenId_t screenid, 
+                  bool isClosed = false);
+
 //
 // Draws a single pixel to a screen.
 //
 void drawPoint(Vector2i position, Color4u color, ScreenId_t screenid);
 
+//
+// Palette index variants of the draw calls; the only way to draw to PALETTE8 screens. On 
+// FULL_RGB screens the index is drawn as its default color (see paletteColor).
+//
+void clearScreenColor(PaletteIndex_t index, ScreenId_t screenid);
+void drawSpriteMask(Vector2i position, ResourceKey_t maskKey, PaletteIndex_t tint, ScreenId_t screenid);
+void drawBorderRectangle(iRect rect, PaletteIndex_t index, ScreenId_t screenid);
+void drawFillRectangle(iRect rect, PaletteIndex_t index, ScreenId_t screenid);
+void drawFillRectangles(const iRect* rects, int count, PaletteIndex_t index, ScreenId_t screenid);
+void drawLine(Vector2i p0, Vector2i p1, PaletteIndex_t index, ScreenId_t screenid);
+void drawLines(const Vector2i* endPoints, int lineCount, PaletteIndex_t index, ScreenId_t screenid);
+void drawPolyline(const Vector2i* points, int pointCount, PaletteIndex_t index, ScreenId_t screenid, 
+                  bool isClosed = false);
+void drawPoint(Vector2i position, PaletteIndex_t index, ScreenId_t screenid);
+
 //
 // Issues opengl calls to render results of (software) draw calls and then swaps the buffers.
 //
 void present();
 
+//
+// Provides access to the statistics gathered by the last call to present.
+//
+const PresentStats& getPresentStats();
+
 //
 // Changes the pixel mode of a screen for all future draw calls.
 //
 void setScreenPixelMode(PixelMode mode, ScreenId_t screenid);
 
+//
+// Changes the draw mode of a screen for all future draw calls. Any draws deferred by the 
+// screen are rasterised before switching to immediate mode.
+//
+void setScreenDrawMode(DrawMode mode, ScreenId_t screenid);
+
+//
+// Sets the max number of threads, including the calling thread, which rasterise the draws of 
+// screens in DrawMode::DEFERRED. Count is clamped to [1, 64]; 1 rasterises on the calling 
+// thread only. The threads are the workers of the jobs module (see pxr_jobs.h) thus at most
+// jobs::getWorkerCount() threads rasterise.
+//
+void setRasterThreadCount(int count);
+int getRasterThreadCount();
+
 //
 // Changes the size mode of a screen with immediate effect.
 //
@@ -446,6 +800,21 @@ void setScreenManualPixelSize(int pxSize, ScreenId_t screenid);
 //
 void setPixelShader(PXShader_t shader, ScreenId_t screenid);
 
+//
+// Sets the span shader function to use for a particular screen. This function will only be 
+// used if the screen is in PixelMode::SHADER. A span shader replaces any pixel shader set for
+// the screen; setting a pixel shader removes the span shader, thus the last shader set is the
+// shader used.
+//
+void setSpanShader(SpanShader_t shader, ScreenId_t screenid);
+
+//
+// Sets the palette of a PALETTE8 screen, e.g. to swap in a color overlay. Takes effect for 
+// the whole screen at the next present. The pixels of the screen are untouched; only the 
+// palette is uploaded. Entry 0 (the key) is always transparent whatever its color in 'palette'.
+//
+void setScreenPalette(const Palette_t& palette, ScreenId_t screenid);
+
 //
 // Enables a screen so it will be rendered to the window.
 //
@@ -460,7 +829,25 @@ void disableScreen(ScreenId_t screenid);
 // Utility function for calculating the dimensions of the smallest possible bounding box of 
 // a text string for a given font. Dimensions are in units of virtual pixels.
 //
-Vector2i calculateTextSize(const std::string& text, ResourceKey_t fontKey);
+Vector2i calculateTextSize(std::string_view text, ResourceKey_t fontKey);
+
+//
+// Statistics of the text run cache used by drawText; hits and misses accumulate from 
+// initialization. calculateTextSize reads the size of cached strings from the cache but
+// neither caches strings nor counts towards the stats.
+//
+struct TextRunCacheStats
+{
+  int64_t _hits;
+  int64_t _misses;
+  int64_t _evictions;
+  int _entries;
+};
+
+//
+// Provides access to the text run cache statistics.
+//
+const TextRunCacheStats& getTextRunCacheStats();
 
 //
 // Utility to test if a spritesheet resource key is associated with the error spritesheet. Allows 
@@ -479,10 +866,24 @@ Vector2i getSpritesheetSize(ResourceKey_t sheetKey);
 Vector2i getSpriteSize(ResourceKey_t sheetKey, SpriteId_t spriteid);
 
 //
-// Provides read only access to internally stored spritesheets.
+// Provides read only access to internally stored spritesheets. The reference is invalidated by
+// subsequent calls to loadSpritesheet; do not hold on to it.
 //
 const Spritesheet& getSpritesheet(ResourceKey_t sheetKey);
 
+bool isErrorSpriteMask(ResourceKey_t maskKey);
+
+//
+// Utility to access the size of a sprite mask.
+//
+Vector2i getSpriteMaskSize(ResourceKey_t maskKey);
+
+//
+// Provides read only access to internally stored sprite masks. The reference is invalidated by
+// subsequent calls to loadSpriteMask; do not hold on to it.
+//
+const SpriteMask& getSpriteMask(ResourceKey_t maskKey);
+
 } // namespace gfx
 } // namespace pxr
 
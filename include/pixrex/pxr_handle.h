@@ -0,0 +1,152 @@
+#ifndef _PIXIRETRO_HANDLE_H_
+#define _PIXIRETRO_HANDLE_H_
+
+#include <vector>
+#include <utility>
+#include <cassert>
+
+namespace pxr
+{
+
+//
+// A dense table of resources addressed by generation-checked handles.
+//
+// Resources are stored contiguously in slots; a handle encodes the index of the slot of its
+// resource in the low bits and the generation of the slot in the high bits. Lookups are thus
+// a single index into the table. When a resource is erased its slot's generation is advanced
+// so handles to the erased resource become stale; stale handles are asserted against on
+// lookup (i.e. detected in debug builds) and can be tested with isValid in all builds.
+//
+// Slots freed by erase are reused by later inserts. Inserts may grow the table, invalidating
+// any references to resources held by callers; resources must be accessed via their handle.
+//
+// Handles are positive ints so can be used in place of the plain int keys used previously.
+//
+template<typename T>
+class HandleTable
+{
+public:
+  using Handle_t = int;
+
+  static constexpr int INDEX_BITS {20};
+  static constexpr int GENERATION_BITS {11};
+  static constexpr int MAX_SLOTS {1 << INDEX_BITS};
+
+  //
+  // A handle which is never valid.
+  //
+  static constexpr Handle_t NULL_HANDLE {0};
+
+public:
+  Handle_t insert(T value)
+  {
+    int index;
+    if(!_freeSlots.empty()){
+      index = _freeSlots.back();
+      _freeSlots.pop_back();
+    }
+    else{
+      assert(_slots.size() < MAX_SLOTS);
+      index = _slots.size();
+      _slots.emplace_back();
+    }
+    Slot& slot = _slots[index];
+    slot._value = std::move(value);
+    slot._isLive = true;
+    ++_liveCount;
+    return makeHandle(index, slot._generation);
+  }
+
+  void erase(Handle_t handle)
+  {
+    assert(isValid(handle));
+    int index = getIndex(handle);
+    Slot& slot = _slots[index];
+    slot._value = T{};
+    slot._isLive = false;
+    slot._generation = nextGeneration(slot._generation);
+    _freeSlots.push_back(index);
+    --_liveCount;
+  }
+
+  void clear()
+  {
+    for(int index = 0; index < static_cast<int>(_slots.size()); ++index)
+      if(_slots[index]._isLive)
+        erase(makeHandle(index, _slots[index]._generation));
+  }
+
+  bool isValid(Handle_t handle) const
+  {
+    int index = getIndex(handle);
+    return 0 <= index && index < static_cast<int>(_slots.size()) &&
+           _slots[index]._isLive &&
+           _slots[index]._generation == getGeneration(handle);
+  }
+
+  //
+  // Unchecked in release builds; use find if the handle may be stale.
+  //
+  T& operator[](Handle_t handle)
+  {
+    assert(isValid(handle));
+    return _slots[getIndex(handle)]._value;
+  }
+
+  const T& operator[](Handle_t handle) const
+  {
+    assert(isValid(handle));
+    return _slots[getIndex(handle)]._value;
+  }
+
+  //
+  // Returns nullptr if the handle is stale.
+  //
+  T* find(Handle_t handle)
+  {
+    return isValid(handle) ? &_slots[getIndex(handle)]._value : nullptr;
+  }
+
+  //
+  // Calls 'f(handle, resource)' for each resource in the table in slot order.
+  //
+  template<typename F>
+  void forEach(F f)
+  {
+    for(int index = 0; index < static_cast<int>(_slots.size()); ++index)
+      if(_slots[index]._isLive)
+        f(makeHandle(index, _slots[index]._generation), _slots[index]._value);
+  }
+
+  int size() const {return _liveCount;}
+
+private:
+  struct Slot
+  {
+    T _value {};
+    int _generation {1};    // starts at 1 so no handle equals NULL_HANDLE.
+    bool _isLive {false};
+  };
+
+  static constexpr int INDEX_MASK {MAX_SLOTS - 1};
+  static constexpr int GENERATION_MASK {(1 << GENERATION_BITS) - 1};
+
+  static Handle_t makeHandle(int index, int generation) {return (generation << INDEX_BITS) | index;}
+  static int getIndex(Handle_t handle) {return handle & INDEX_MASK;}
+  static int getGeneration(Handle_t handle) {return (handle >> INDEX_BITS) & GENERATION_MASK;}
+
+  static int nextGeneration(int generation)
+  {
+    generation = (generation + 1) & GENERATION_MASK;
+    return generation == 0 ? 1 : generation;
+  }
+
+private:
+  std::vector<Slot> _slots;
+  std::vector<int> _freeSlots;
+  int _liveCount {0};
+};
+
+} // namespace pxr
+
+#endif
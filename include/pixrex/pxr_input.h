@@ -67,6 +67,53 @@ int keyToAsciiCode(KeyCode key);
 //
 KeyCode keyStringToKeyCode(const std::string& keyString);
 
+//
+// RECORD AND REPLAY
+//
+// Key events can be recorded and replayed, making a play session a repeatable workload. Each 
+// event is recorded with the number of the update tick it was first visible to, along with the
+// state of the rand::generator when recording started; replay restores the generator state and
+// feeds each event back before the same tick, ignoring live key events. Thus an app which 
+// depends only on the tick period, its input and the rand module replays identically, provided
+// the replay runs at the same fps lock as the recording.
+//
+// Ticks are counted by onUpdate from the start of a recording or replay, so both must start at
+// the same point in an app's life, e.g. the engine starts them when its main loop starts.
+// Replay loads the whole recording up front so feeding events never allocates.
+//
+// Recordings are a small header followed by 4 bytes per event, stored in native byte order.
+// Ticks are stored in 25 bits, limiting recordings to ~6 days at 60hz.
+//
+
+//
+// The name of the recording file to write and replay on the filesystem.
+//
+static constexpr const char* RECORDING_FILENAME {"input.rec"};
+
+//
+// Starts recording key events, clearing the state of all keys. Recording continues until
+// stopped.
+//
+void startRecording();
+
+//
+// Stops recording and writes the recording to a file. Returns false if the file could not be
+// written.
+//
+bool stopRecording(const char* filename = RECORDING_FILENAME);
+
+//
+// Loads a recording and starts replaying it, clearing the state of all keys. Replay continues 
+// for as many ticks as were recorded or until stopped. Returns false if the recording could not be 
+// loaded, in which case input remains live.
+//
+bool startReplay(const char* filename = RECORDING_FILENAME);
+
+void stopReplay();
+
+bool isRecording();
+bool isReplaying();
+
 } // namespace input
 } // namespace pxr
 
@@ -0,0 +1,171 @@
+#ifndef _PIXIRETRO_JOBS_H_
+#define _PIXIRETRO_JOBS_H_
+
+#include <cstdint>
+#include <array>
+#include <atomic>
+#include <mutex>
+#include <algorithm>
+
+namespace pxr
+{
+namespace jobs
+{
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// PIXIRETRO JOBS
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// This module runs jobs on a fixed pool of worker threads. A job is a function and a pointer
+// to its data, which must remain valid until the job has run,
+//
+//      jobs::Counter counter {};
+//      jobs::run(foo, &fooData, &counter);
+//      jobs::run(bar, &barData, &counter);
+//      jobs::wait(counter);               // foo and bar are done.
+//
+// Counters count the jobs run against them which are not yet done; wait blocks until a counter
+// reaches zero. A job can depend on a counter with runAfter, in which case it runs once the
+// counter reaches zero. Thus all jobs should be run against a counter before any jobs are run
+// after it, else the dependents may run as soon as the first jobs finish.
+//
+// The thread which initializes the module (the main thread) is worker 0; the pool holds the
+// other workers. Each worker has its own deque of jobs; workers push and pop jobs at the back
+// of their own deque and, when theirs is empty, steal jobs from the front of the deques of
+// other workers. Jobs run from other threads are shared via a separate queue. Scheduling never
+// allocates; a job which cannot be queued as its deque is full runs immediately instead.
+//
+// Waiting threads run jobs whilst they wait (thus a job may wait on jobs it runs), and the
+// main thread runs jobs only whilst waiting. Idle workers sleep until jobs are run.
+//
+// Each worker records the time spent running jobs; see getWorkerStats. Jobs appear in
+// profile traces as "jobs::job" scopes on "jobs worker" threads.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+static constexpr int MAX_WORKERS {64};
+
+//
+// The number of jobs each worker's deque can hold; a power of 2.
+//
+static constexpr int DEQUE_CAPACITY {1 << 12};
+
+//
+// The number of jobs each counter can hold to be run after it.
+//
+static constexpr int MAX_CONTINUATIONS {8};
+
+using JobFunction_t = void (*)(void* data);
+
+struct Counter;
+
+struct Job
+{
+  JobFunction_t _function;
+  void* _data;
+  Counter* _counter;
+};
+
+//
+// The members of a counter are internal to this module. A counter must not be destroyed
+// whilst it has jobs outstanding, and if waited on, not before wait returns.
+//
+struct Counter
+{
+  Counter() = default;
+  Counter(const Counter&) = delete;
+  Counter& operator=(const Counter&) = delete;
+
+  bool isDone() const {return _pending.load(std::memory_order_acquire) == 0;}
+
+  std::atomic<int> _pending {0};
+  std::mutex _continuationsMutex;
+  std::array<Job, MAX_CONTINUATIONS> _continuations;
+  int _continuationCount {0};
+};
+
+struct WorkerStats
+{
+  int64_t _busyNanos;       // time spent running jobs.
+  int64_t _jobsDone;
+  int64_t _jobsStolen;      // jobs taken from the deques of other workers.
+};
+
+//
+// Starts the worker pool. The count includes the calling thread and is clamped to
+// [1, MAX_WORKERS]; 1 runs all jobs on the thread which runs or waits on them. Jobs run prior
+// to initialization run immediately.
+//
+void initialize(int workerCount);
+
+//
+// Stops the worker pool once the queued jobs are done and logs the stats of each worker.
+//
+void shutdown();
+
+int getWorkerCount();
+
+//
+// Queues a job. If counter is not null the job is counted against it until done.
+//
+void run(JobFunction_t function, void* data, Counter* counter = nullptr);
+
+//
+// Queues a job to run once the dependency counter reaches zero; immediately if it is zero.
+// If the dependency already holds MAX_CONTINUATIONS jobs, waits on the dependency instead.
+//
+void runAfter(Counter& dependency, JobFunction_t function, void* data, Counter* counter = nullptr);
+
+//
+// Runs jobs until the counter reaches zero.
+//
+void wait(Counter& counter);
+
+WorkerStats getWorkerStats(int worker);
+
+//
+// Calls function(chunkBegin, chunkEnd) on chunks of [begin, end) of at most grain indices
+// in parallel on at most maxThreads threads, including the calling thread. Returns once all
+// chunks are done. Chunks are shared dynamically so uneven chunks balance out.
+//
+template<typename Function>
+void parallelFor(int begin, int end, int grain, const Function& function, int maxThreads = MAX_WORKERS)
+{
+  struct Loop
+  {
+    const Function* _function;
+    std::atomic<int> _next;
+    int _end;
+    int _grain;
+
+    static void runChunks(void* data)
+    {
+      Loop& loop = *static_cast<Loop*>(data);
+      int chunkBegin;
+      while((chunkBegin = loop._next.fetch_add(loop._grain, std::memory_order_relaxed)) < loop._end)
+        (*loop._function)(chunkBegin, std::min(chunkBegin + loop._grain, loop._end));
+    }
+  };
+
+  if(begin >= end)
+    return;
+
+  grain = std::max(grain, 1);
+  Loop loop {&function, {begin}, end, grain};
+
+  int chunkCount = (end - begin + grain - 1) / grain;
+  int helperCount = std::min({chunkCount, maxThreads, getWorkerCount()}) - 1;
+
+  Counter counter {};
+  for(int i = 0; i < helperCount; ++i)
+    run(&Loop::runChunks, &loop, &counter);
+  Loop::runChunks(&loop);
+  wait(counter);
+}
+
+} // namespace jobs
+} // namespace pxr
+
+#endif
@@ -2,6 +2,7 @@
 #define _PIXIRETRO_LOG_H_  
 
 #include <array>
+#include <string_view>
 
 namespace pxr
 {
@@ -23,8 +24,16 @@ LOGSTR msg_log_to_stderr = "logging to standard error";
 
 LOGSTR msg_eng_fail_sdl_init = "failed to initialize SDL";
 LOGSTR msg_eng_locking_fps = "locking fps to";
+LOGSTR msg_eng_locking_draw_fps = "locking draw fps to";
 LOGSTR msg_eng_fail_load_splash = "failed to splash sprite : skipping splash screen";
 LOGSTR msg_eng_fail_init_app = "failed to initialize the app";
+LOGSTR msg_eng_invalid_gfx_backend_env = "invalid PXR_GFX_BACKEND : expected opengl or headless";
+LOGSTR msg_eng_threaded_update = "running update ticks on their own thread";
+LOGSTR msg_eng_no_app_snapshots = "app has no snapshots : running update ticks on the main thread";
+LOGSTR msg_eng_dropped_key_events = "key events dropped as the update thread queue was full";
+LOGSTR msg_eng_fast_forwarding = "fast forwarding ticks unpaced";
+LOGSTR msg_eng_fast_forward_done = "fast forward done";
+LOGSTR msg_eng_no_alloc_tracking = "assertNoFrameAllocs set but not built with PXR_ALLOC_TRACKING : ignoring";
 
 //
 // gfx log strings.
@@ -39,17 +48,27 @@ LOGSTR msg_gfx_created_window = "successfully created window";
 LOGSTR msg_gfx_fail_create_opengl_context = "failed to create opengl context";
 LOGSTR msg_gfx_fail_set_opengl_attribute = "failed to set opengl attribute";
 LOGSTR msg_gfx_opengl_version = "using opengl version";
+LOGSTR msg_gfx_fail_parse_opengl_version = "failed to parse opengl version string";
+LOGSTR msg_gfx_opengl_version_below_min = "opengl version below minimum requirement : rendering may fail";
 LOGSTR msg_gfx_opengl_renderer = "using opengl renderer";
 LOGSTR msg_gfx_opengl_vendor = "using opengl vendor";
 LOGSTR msg_gfx_loading_spritesheets = "starting spritesheet loading";
 LOGSTR msg_gfx_loading_spritesheet = "loading spritesheet";
 LOGSTR msg_gfx_spritesheet_already_loaded = "spritesheet already loaded";
 LOGSTR msg_gfx_loading_spritesheet_success = "successfully loaded spritesheet";
+LOGSTR msg_gfx_loading_spritemask = "loading sprite mask";
+LOGSTR msg_gfx_spritemask_already_loaded = "sprite mask already loaded";
+LOGSTR msg_gfx_loading_spritemask_success = "successfully loaded sprite mask";
+LOGSTR msg_gfx_fail_open_spritemask = "failed to open sprite mask file";
+LOGSTR msg_gfx_spritemask_invalid = "invalid sprite mask : rows must be equal length strings of '0' and '1'";
+LOGSTR msg_gfx_using_error_spritemask = "substituting unloaded sprite mask with error sprite mask";
+LOGSTR msg_gfx_unload_spritemask_success = "successfully unloaded sprite mask";
 LOGSTR msg_gfx_loading_font = "loading font";
 LOGSTR msg_gfx_loading_font_success = "successfully loaded font";
 LOGSTR msg_gfx_fail_load_asset_bmp = "failed to load the bitmap image of asset";
 LOGSTR msg_gfx_using_error_spritesheet = "substituting unloaded spritesheet with error spritesheet";
 LOGSTR msg_gfx_using_error_font = "substituting unloaded font with error font";
+LOGSTR msg_gfx_palette_asset_not_indexed = "rejected asset loaded for palette screens as its bitmap is not indexed";
 LOGSTR msg_gfx_loading_fonts = "starting font loading";
 LOGSTR msg_gfx_pixel_size_range = "range of valid pixel sizes";
 LOGSTR msg_gfx_created_vscreen = "created vscreen";
@@ -60,6 +79,12 @@ LOGSTR msg_gfx_font_invalid_xml_bmp_mismatch = "invalid font : char xml meta ext
 LOGSTR msg_gfx_unloading_nonexistent_resource = "trying to unload nonexistent resource";
 LOGSTR msg_gfx_unload_spritesheet_success = "successfully unloaded spritesheet";
 LOGSTR msg_gfx_unload_font_success = "successfully unloaded font";
+LOGSTR msg_gfx_present_mode = "using present mode";
+LOGSTR msg_gfx_backend = "using backend";
+LOGSTR msg_gfx_blit_kernel = "using blit kernel";
+LOGSTR msg_gfx_raster_threads = "using raster threads";
+LOGSTR msg_gfx_fail_load_texture_procs = "opengl context lacks pixel buffer objects : falling back to points present mode";
+LOGSTR msg_gfx_fail_create_palette_program = "failed to build the palette lookup shader : falling back to points present mode";
 
 //
 // sfx log strings.
@@ -87,6 +112,35 @@ LOGSTR msg_sfx_load_sound_success = "successfully loaded sound";
 LOGSTR msg_sfx_unload_sound_success = "successfully unloaded sound";
 
 
+//
+// input log strings.
+//
+
+LOGSTR msg_inp_recording = "recording input";
+LOGSTR msg_inp_writing_recording = "writing input recording";
+LOGSTR msg_inp_fail_open_recording = "failed to open input recording file";
+LOGSTR msg_inp_fail_write_recording = "failed to write input recording file";
+LOGSTR msg_inp_recording_written = "successfully wrote input recording";
+LOGSTR msg_inp_recording_corrupted = "input recording file corrupted";
+LOGSTR msg_inp_replaying = "replaying input recording";
+LOGSTR msg_inp_replay_done = "input replay finished";
+
+//
+// jobs log strings.
+//
+
+LOGSTR msg_job_workers = "job workers";
+LOGSTR msg_job_worker_stats = "job worker stats";
+
+//
+// profile log strings.
+//
+
+LOGSTR msg_prf_writing_trace = "writing profile trace";
+LOGSTR msg_prf_fail_open_trace = "failed to open profile trace file";
+LOGSTR msg_prf_fail_write_trace = "failed to write profile trace file";
+LOGSTR msg_prf_trace_written = "successfully wrote profile trace";
+
 //
 // xml log strings.
 //
@@ -208,7 +262,7 @@ void shutdown();
 //
 // where the <prefix> is determined by the log level.
 //
-void log(Level level, const char* error, const std::string& addendum = std::string{});
+void log(Level level, const char* error, std::string_view addendum = {});
 
 } // namespace log
 } // namespace pxr
@@ -0,0 +1,114 @@
+#ifndef _PIXIRETRO_PROFILE_H_
+#define _PIXIRETRO_PROFILE_H_
+
+#include <cstdint>
+#include <chrono>
+
+namespace pxr
+{
+namespace profile
+{
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// PIXIRETRO PROFILER
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// This module records the time spent in marked scopes of code and writes the recorded scopes
+// as a chrome trace_event json file, viewable in chrome://tracing or https://ui.perfetto.dev.
+//
+// Scopes are marked with the PXR_PROFILE_SCOPE macro which times the remainder of the
+// enclosing block,
+//
+//      void foo()
+//      {
+//        PXR_PROFILE_SCOPE("foo");
+//        ...
+//      }
+//
+// Scopes nest; the trace viewer shows nested scopes beneath their parents. The scope name must
+// be a string literal (or otherwise outlive the program) as only the pointer is recorded.
+//
+// Each thread records into its own fixed size ring of events, allocated on the first scope the
+// thread records; recording thereafter takes no locks and never allocates. When a ring is full
+// the oldest events are overwritten, thus a trace holds the most recent EVENT_BUFFER_CAPACITY
+// scopes of each thread. Rings are only read when writing a trace.
+//
+// The profiler is compiled only if PXR_PROFILE is defined (e.g. -DPXR_PROFILE); otherwise the
+// scope macro expands to nothing and the functions below are empty inlines, so the profiler
+// costs nothing when disabled.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+//
+// The name of the trace file to create and write to on the filesystem.
+//
+static constexpr const char* TRACE_FILENAME {"trace.json"};
+
+//
+// The number of events held in the ring of each thread.
+//
+static constexpr int EVENT_BUFFER_CAPACITY {1 << 16};
+
+#define PXR_PROFILE_JOIN_IMPL(a, b) a##b
+#define PXR_PROFILE_JOIN(a, b) PXR_PROFILE_JOIN_IMPL(a, b)
+
+#ifdef PXR_PROFILE
+
+//
+// Nanoseconds on the steady clock; the time base of events.
+//
+inline int64_t getNow()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//
+// Records a scope which began at 'begin' and ended at 'end' in the ring of the calling thread.
+//
+void recordScope(const char* name, int64_t begin, int64_t end);
+
+//
+// Names the calling thread in traces; threads not named appear as "thread <n>".
+//
+void setThreadName(const char* name);
+
+//
+// Writes the events held in all rings to a trace file. Scopes recorded whilst writing may be
+// missing from the trace. Returns false if the file could not be written.
+//
+bool writeTrace(const char* filename = TRACE_FILENAME);
+
+//
+// Times its own lifetime; use via PXR_PROFILE_SCOPE.
+//
+class Scope
+{
+public:
+  explicit Scope(const char* name) : _name{name}, _begin{getNow()}{}
+  ~Scope(){recordScope(_name, _begin, getNow());}
+  Scope(const Scope&) = delete;
+  Scope& operator=(const Scope&) = delete;
+
+private:
+  const char* _name;
+  int64_t _begin;
+};
+
+#define PXR_PROFILE_SCOPE(name) ::pxr::profile::Scope PXR_PROFILE_JOIN(pxrProfileScope, __LINE__){name}
+
+#else
+
+inline void setThreadName(const char* name){}
+inline bool writeTrace(const char* filename = TRACE_FILENAME){return false;}
+
+#define PXR_PROFILE_SCOPE(name)
+
+#endif
+
+} // namespace profile
+} // namespace pxr
+
+#endif
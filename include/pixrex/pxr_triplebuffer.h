@@ -0,0 +1,62 @@
+#ifndef _PIXIRETRO_TRIPLEBUFFER_H_
+#define _PIXIRETRO_TRIPLEBUFFER_H_
+
+#include <array>
+#include <atomic>
+
+namespace pxr
+{
+
+//
+// Hands values from a single writer thread to a single reader thread without locks or waits.
+//
+// The buffer holds 3 values: the back, written by the writer; the front, read by the reader;
+// and the middle, the most recently published value not yet taken by the reader. Publishing
+// swaps the back with the middle; acquiring swaps the front with the middle if the middle has
+// been published since last acquired. Thus the writer never waits for the reader and the reader
+// always reads the latest complete value; values published faster than they are acquired are
+// dropped.
+//
+// The back and front are owned by their threads until the next publish and acquire, so may be
+// reused in place; e.g. the writer can keep allocations in the back between publishes.
+//
+template<typename T>
+class TripleBuffer
+{
+public:
+  //
+  // Writer side.
+  //
+  T& getBack() {return _slots[_back];}
+
+  void publish()
+  {
+    _back = _middle.exchange(_back | FRESH_BIT, std::memory_order_acq_rel) & INDEX_MASK;
+  }
+
+  //
+  // Reader side. Returns true if a newer value was acquired, else the front is unchanged.
+  //
+  bool acquire()
+  {
+    if((_middle.load(std::memory_order_relaxed) & FRESH_BIT) == 0)
+      return false;
+    _front = _middle.exchange(_front, std::memory_order_acq_rel) & INDEX_MASK;
+    return true;
+  }
+
+  const T& getFront() const {return _slots[_front];}
+
+private:
+  static constexpr int FRESH_BIT {0x4};
+  static constexpr int INDEX_MASK {0x3};
+
+  std::array<T, 3> _slots;
+  int _back {0};
+  std::atomic<int> _middle {1};
+  int _front {2};
+};
+
+} // namespace pxr
+
+#endif
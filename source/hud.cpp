@@ -1,3 +1,4 @@
+#include <cstdio>
 #include "hud.h"
 
 HUD::Label::Label(
@@ -127,19 +128,14 @@ void HUD::IntLabel::onUpdate(float dt)
 
   if(!_isActive) return;
 
+  //
+  // Formatted in a fixed buffer, zero padded to the precision, so a changing value does not
+  // allocate a temporary string on every change.
+  //
   if(_displayValue != _sourceValue){
-    std::string valueStr = std::to_string(_sourceValue);
-    _displayStr.clear();
-    int sign{0};
-    if(_sourceValue < 0){
-      assert(valueStr.front() == '-');
-      sign = 1;
-      _displayStr += '-';
-    }
-    for(int i{0}; i < _precision - (valueStr.length() - sign); ++i){
-      _displayStr += '0';
-    }
-    _displayStr.append(valueStr.begin() + sign, valueStr.end());
+    char digits[24];
+    std::snprintf(digits, sizeof(digits), "%.*d", _precision, _sourceValue);
+    _displayStr.assign(digits);
     _displayValue = _sourceValue;
   }
 }
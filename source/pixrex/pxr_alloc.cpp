@@ -0,0 +1,114 @@
+#include "pxr_alloc.h"
+
+#ifdef PXR_ALLOC_TRACKING
+
+#include <new>
+#include <atomic>
+#include <cstdlib>
+#include <cstdio>
+#include <algorithm>
+
+namespace pxr
+{
+namespace alloc
+{
+
+//
+// The counts are shared by all threads; relaxed atomics as they need only be eventually
+// consistent.
+//
+static std::atomic<int64_t> allocCount {0};
+static std::atomic<int64_t> allocBytes {0};
+
+static thread_local bool isForbidding {false};
+
+static void onAllocate(std::size_t size)
+{
+  allocCount.fetch_add(1, std::memory_order_relaxed);
+  allocBytes.fetch_add(size, std::memory_order_relaxed);
+
+  if(isForbidding){
+    isForbidding = false;
+    std::fprintf(stderr, "pxr::alloc: allocation of %zu bytes whilst forbidden\n", size);
+    std::abort();
+  }
+}
+
+AllocStats getStats()
+{
+  return AllocStats{
+    allocCount.load(std::memory_order_relaxed),
+    allocBytes.load(std::memory_order_relaxed)
+  };
+}
+
+ForbidScope::ForbidScope(bool forbid) :
+  _wasForbidding{isForbidding}
+{
+  isForbidding = forbid;
+}
+
+ForbidScope::~ForbidScope()
+{
+  isForbidding = _wasForbidding;
+}
+
+} // namespace alloc
+} // namespace pxr
+
+//
+// The array and nothrow forms of new and the sized and array forms of delete are by default
+// implemented in terms of these, so need not be replaced.
+//
+
+void* operator new(std::size_t size)
+{
+  pxr::alloc::onAllocate(size);
+  if(size == 0)
+    size = 1;
+  void* p {nullptr};
+  while((p = std::malloc(size)) == nullptr){
+    std::new_handler handler = std::get_new_handler();
+    if(handler == nullptr)
+      throw std::bad_alloc{};
+    handler();
+  }
+  return p;
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment)
+{
+  pxr::alloc::onAllocate(size);
+  auto align = static_cast<std::size_t>(alignment);
+  std::size_t alignedSize = ((std::max<std::size_t>(size, 1) + align - 1) / align) * align;
+  void* p {nullptr};
+  while((p = std::aligned_alloc(align, alignedSize)) == nullptr){
+    std::new_handler handler = std::get_new_handler();
+    if(handler == nullptr)
+      throw std::bad_alloc{};
+    handler();
+  }
+  return p;
+}
+
+void operator delete(void* p) noexcept
+{
+  std::free(p);
+}
+
+void operator delete(void* p, std::size_t size) noexcept
+{
+  std::free(p);
+}
+
+void operator delete(void* p, std::align_val_t alignment) noexcept
+{
+  std::free(p);
+}
+
+void operator delete(void* p, std::size_t size, std::align_val_t alignment) noexcept
+{
+  std::free(p);
+}
+
+#endif
@@ -0,0 +1,264 @@
+#include <SDL2/SDL.h>
+#include <cinttypes>
+#include <cstring>
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define PXR_BLIT_X86
+#include <immintrin.h>
+#endif
+
+#include "pxr_blit.h"
+#include "pxr_color.h"
+
+namespace pxr
+{
+namespace gfx
+{
+
+/////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// MODULE DATA
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////
+
+static constexpr int ALPHA_KEY = 0;
+
+using BlitRowKeyed_t = void (*)(Color4u* dst, const Color4u* src, int count);
+using BlitRowFill_t = void (*)(Color4u* dst, Color4u color, int count);
+using BlitRowPalette_t = void (*)(Color4u* dst, const uint8_t* src, const Color4u* palette, int count);
+
+static void blitRowKeyedScalar(Color4u* dst, const Color4u* src, int count);
+static void blitRowFillScalar(Color4u* dst, Color4u color, int count);
+static void blitRowPaletteScalar(Color4u* dst, const uint8_t* src, const Color4u* palette, int count);
+
+static BlitKernel kernel {BlitKernel::SCALAR};
+static BlitRowKeyed_t blitRowKeyedImpl {blitRowKeyedScalar};
+static BlitRowFill_t blitRowFillImpl {blitRowFillScalar};
+static BlitRowPalette_t blitRowPaletteImpl {blitRowPaletteScalar};
+
+/////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// SCALAR KERNELS
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////
+
+static void blitRowKeyedScalar(Color4u* dst, const Color4u* src, int count)
+{
+  for(int i = 0; i < count; ++i)
+    if(src[i]._a != ALPHA_KEY)
+      dst[i] = src[i];
+}
+
+static void blitRowFillScalar(Color4u* dst, Color4u color, int count)
+{
+  std::fill_n(dst, count, color);
+}
+
+static void blitRowPaletteScalar(Color4u* dst, const uint8_t* src, const Color4u* palette, int count)
+{
+  for(int i = 0; i < count; ++i)
+    dst[i] = palette[src[i]];
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// X86 KERNELS
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifdef PXR_BLIT_X86
+
+//
+// Color4u is laid out r,g,b,a in memory thus when loaded as a little-endian 32-bit lane the
+// alpha channel is the most significant byte.
+//
+static constexpr int32_t ALPHA_LANE_MASK = static_cast<int32_t>(0xff000000);
+
+//
+// SSE2 has only the byte-granular, non-temporal maskmovdqu as a masked store which bypasses
+// the cache; since screens are reread every frame the keyed pixels are instead blended with
+// the loaded dst pixels and stored whole.
+//
+__attribute__((target("sse2")))
+static void blitRowKeyedSSE2(Color4u* dst, const Color4u* src, int count)
+{
+  const __m128i alphaMask = _mm_set1_epi32(ALPHA_LANE_MASK);
+  const __m128i zero = _mm_setzero_si128();
+  int i = 0;
+  for(; i + 4 <= count; i += 4){
+    __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+    __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + i));
+    __m128i keyed = _mm_cmpeq_epi32(_mm_and_si128(s, alphaMask), zero);
+    __m128i r = _mm_or_si128(_mm_and_si128(keyed, d), _mm_andnot_si128(keyed, s));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), r);
+  }
+  blitRowKeyedScalar(dst + i, src + i, count - i);
+}
+
+__attribute__((target("avx2")))
+static void blitRowKeyedAVX2(Color4u* dst, const Color4u* src, int count)
+{
+  const __m256i alphaMask = _mm256_set1_epi32(ALPHA_LANE_MASK);
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i ones = _mm256_set1_epi32(-1);
+  int i = 0;
+  for(; i + 8 <= count; i += 8){
+    __m256i s = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+    __m256i keyed = _mm256_cmpeq_epi32(_mm256_and_si256(s, alphaMask), zero);
+    __m256i opaque = _mm256_xor_si256(keyed, ones);
+    _mm256_maskstore_epi32(reinterpret_cast<int*>(dst + i), opaque, s);
+  }
+  blitRowKeyedSSE2(dst + i, src + i, count - i);
+}
+
+//
+// The fill kernels broadcast the color to all lanes of a register and store it whole, thus any
+// color is filled at the same rate (unlike memset which can only fill a repeated byte). The
+// stores are aligned after a scalar head and unrolled so the loop is bound by store bandwidth.
+// Regular (not streaming) stores are used since filled screens are reread when presented.
+//
+static inline uint32_t colorBits(Color4u color)
+{
+  uint32_t bits;
+  std::memcpy(&bits, &color, sizeof(bits));
+  return bits;
+}
+
+template<int Alignment>
+static inline int alignmentHead(const Color4u* dst, int count)
+{
+  int misalign = reinterpret_cast<uintptr_t>(dst) & (Alignment - 1);
+  if(misalign == 0 || (misalign % sizeof(Color4u)) != 0)
+    return 0;
+  return std::min(count, static_cast<int>((Alignment - misalign) / sizeof(Color4u)));
+}
+
+__attribute__((target("sse2")))
+static void blitRowFillSSE2(Color4u* dst, Color4u color, int count)
+{
+  const __m128i c = _mm_set1_epi32(colorBits(color));
+  int i = alignmentHead<16>(dst, count);
+  blitRowFillScalar(dst, color, i);
+  for(; i + 16 <= count; i += 16){
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i +  0), c);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i +  4), c);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i +  8), c);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i + 12), c);
+  }
+  for(; i + 4 <= count; i += 4)
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), c);
+  blitRowFillScalar(dst + i, color, count - i);
+}
+
+__attribute__((target("avx2")))
+static void blitRowFillAVX2(Color4u* dst, Color4u color, int count)
+{
+  const __m256i c = _mm256_set1_epi32(colorBits(color));
+  int i = alignmentHead<32>(dst, count);
+  blitRowFillScalar(dst, color, i);
+  for(; i + 32 <= count; i += 32){
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i +  0), c);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i +  8), c);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i + 16), c);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i + 24), c);
+  }
+  for(; i + 8 <= count; i += 8)
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), c);
+  blitRowFillSSE2(dst + i, color, count - i);
+}
+
+//
+// SSE2 has no gather so palette lookups use the scalar kernel on SSE2 only cpus.
+//
+__attribute__((target("avx2")))
+static void blitRowPaletteAVX2(Color4u* dst, const uint8_t* src, const Color4u* palette, int count)
+{
+  const int* table = reinterpret_cast<const int*>(palette);
+  int i = 0;
+  for(; i + 8 <= count; i += 8){
+    __m128i bytes = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + i));
+    __m256i indices = _mm256_cvtepu8_epi32(bytes);
+    __m256i colors = _mm256_i32gather_epi32(table, indices, sizeof(Color4u));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), colors);
+  }
+  blitRowPaletteScalar(dst + i, src + i, palette, count - i);
+}
+
+#endif
+
+/////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// MODULE FUNCTIONS
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////
+
+static bool isKernelSupported(BlitKernel k)
+{
+  switch(k){
+#ifdef PXR_BLIT_X86
+    case BlitKernel::AVX2: return SDL_HasAVX2();
+    case BlitKernel::SSE2: return SDL_HasSSE2();
+#endif
+    case BlitKernel::SCALAR: return true;
+    default: return false;
+  }
+}
+
+void setBlitKernel(BlitKernel k)
+{
+  if(k == BlitKernel::AVX2 && !isKernelSupported(BlitKernel::AVX2))
+    k = BlitKernel::SSE2;
+  if(k == BlitKernel::SSE2 && !isKernelSupported(BlitKernel::SSE2))
+    k = BlitKernel::SCALAR;
+
+  kernel = k;
+
+  switch(kernel){
+#ifdef PXR_BLIT_X86
+    case BlitKernel::AVX2:
+      blitRowKeyedImpl = blitRowKeyedAVX2;
+      blitRowFillImpl = blitRowFillAVX2;
+      blitRowPaletteImpl = blitRowPaletteAVX2;
+      break;
+    case BlitKernel::SSE2:
+      blitRowKeyedImpl = blitRowKeyedSSE2;
+      blitRowFillImpl = blitRowFillSSE2;
+      blitRowPaletteImpl = blitRowPaletteScalar;
+      break;
+#endif
+    default:
+      blitRowKeyedImpl = blitRowKeyedScalar;
+      blitRowFillImpl = blitRowFillScalar;
+      blitRowPaletteImpl = blitRowPaletteScalar;
+      break;
+  }
+}
+
+void initializeBlit()
+{
+  setBlitKernel(BlitKernel::AVX2);
+}
+
+BlitKernel getBlitKernel()
+{
+  return kernel;
+}
+
+void blitRowKeyed(Color4u* dst, const Color4u* src, int count)
+{
+  blitRowKeyedImpl(dst, src, count);
+}
+
+void blitRowFill(Color4u* dst, Color4u color, int count)
+{
+  blitRowFillImpl(dst, color, count);
+}
+
+void blitRowPalette(Color4u* dst, const uint8_t* src, const Color4u* palette, int count)
+{
+  blitRowPaletteImpl(dst, src, palette, count);
+}
+
+} // namespace gfx
+} // namespace pxr
@@ -31,7 +31,8 @@ Bmp::~Bmp()
 
 Bmp::Bmp(const Bmp& other) :
   _pixels{nullptr},
-  _size{0, 0}
+  _size{0, 0},
+  _indices{other._indices}
 {
   _size = other._size;
   _pixels = new gfx::Color4u*[_size._y];
@@ -41,7 +42,8 @@ Bmp::Bmp(const Bmp& other) :
   }
 }
 
-Bmp::Bmp(Bmp&& other)
+Bmp::Bmp(Bmp&& other) :
+  _indices{std::move(other._indices)}
 {
   _pixels = other._pixels;
   other._pixels = nullptr;
@@ -51,6 +53,7 @@ Bmp::Bmp(Bmp&& other)
 
 Bmp& Bmp::operator=(const Bmp& other)
 {
+  _indices = other._indices;
   if(_pixels != nullptr && _size == other._size){ 
     for(int row = 0; row < _size._y; ++row){
       memcpy(static_cast<void*>(_pixels[row]), static_cast<void*>(other._pixels[row]), _size._x * sizeof(gfx::Color4u));
@@ -75,6 +78,7 @@ Bmp& Bmp::operator=(Bmp&& other)
   other._pixels = nullptr;
   _size = other._size;
   other._size.zero();
+  _indices = std::move(other._indices);
   return *this;
 }
 
@@ -168,6 +172,7 @@ bool Bmp::load(std::string filepath)
   }
 
   reallocatePixels();
+  _indices.clear();
 
   switch(infoHead._bitsPerPixel)
   {
@@ -213,6 +218,7 @@ void Bmp::create(Vector2i size, gfx::Color4u clearColor)
 {
   _size = size;
   reallocatePixels(); 
+  _indices.clear();
   clear(clearColor);
 }
 
@@ -226,6 +232,16 @@ void Bmp::clear(gfx::Color4u color)
       _pixels[row][col] = color;
 }
 
+void Bmp::mapIndices(const gfx::Color4u* colors)
+{
+  if(_indices.empty())
+    return;
+
+  for(int row = 0; row < _size._y; ++row)
+    for(int col = 0; col < _size._x; ++col)
+      _pixels[row][col] = colors[_indices[col + (row * _size._x)]];
+}
+
 void Bmp::freePixels()
 {
   if(_pixels != nullptr){
@@ -247,9 +263,14 @@ void Bmp::reallocatePixels()
 void Bmp::extractIndexedPixels(std::ifstream& file, FileHeader& fileHead, InfoHeader& infoHead)
 {
   // extract the color palette.
+  // a palette color count of 0 means the palette holds all 2^n colors.
+  int numPaletteColors = infoHead._numPaletteColors;
+  if(numPaletteColors == 0)
+    numPaletteColors = 1 << infoHead._bitsPerPixel;
+
   std::vector<gfx::Color4u> palette {};
   file.seekg(FILEHEADER_SIZE_BYTES + infoHead._headerSize_bytes, std::ios::beg);
-  for(uint8_t i = 0; i < infoHead._numPaletteColors; ++i){
+  for(int i = 0; i < numPaletteColors; ++i){
     char bytes[4];
     file.read(bytes, 4);
 
@@ -278,6 +299,8 @@ void Bmp::extractIndexedPixels(std::ifstream& file, FileHeader& fileHead, InfoHe
     rowOffset_bytes *= -1;
   }
 
+  _indices.resize(_size._x * _size._y);
+
   int seekPos {pixelOffset_bytes};
   char* buffer = new char[rowSize_bytes];
 
@@ -299,6 +322,7 @@ void Bmp::extractIndexedPixels(std::ifstream& file, FileHeader& fileHead, InfoHe
       int shift = infoHead._bitsPerPixel * (numPixelsPerByte - 1 - bytePixelNo);
       uint8_t index = (byte & (mask << shift)) >> shift;
       _pixels[row][col] = palette[index];
+      _indices[col + (row * _size._x)] = index;
       ++col;
       ++bytePixelNo;
     }
@@ -1,6 +1,7 @@
 #include <cassert>
 #include "pxr_collision.h"
 #include "pxr_bmp.h"
+#include "pxr_profile.h"
 
 namespace pxr
 {
@@ -129,6 +130,7 @@ const CollisionResult& isPixelIntersection(const CollisionSubject& a,
                                            const CollisionSubject& b,
                                            bool pixelLists)
 {
+  PXR_PROFILE_SCOPE("isPixelIntersection");
 
   const gfx::Spritesheet& aSheet = gfx::getSpritesheet(a._spritesheetKey);
   const gfx::Spritesheet& bSheet = gfx::getSpritesheet(b._spritesheetKey);
@@ -1,8 +1,13 @@
 #include <SDL2/SDL.h>
 #include <thread>
 #include <sstream>
-#include <iomanip>
 #include <cassert>
+#include <cstdlib>
+#include <cmath>
+#include <algorithm>
+#include <limits>
+#include <cstdio>
+#include <ctime>
 #include "pxr_engine.h"
 #include "pxr_log.h"
 #include "pxr_app.h"
@@ -10,6 +15,9 @@
 #include "pxr_gfx.h"
 #include "pxr_sfx.h"
 #include "pxr_color.h"
+#include "pxr_profile.h"
+#include "pxr_alloc.h"
+#include "pxr_jobs.h"
 
 #include <iostream>
 
@@ -30,6 +38,14 @@ void Engine::GameClock::update(Duration_t realDt)
     _now += Duration_t{static_cast<int64_t>(realDt.count() * _scale)};
 }
 
+bool Engine::GameClock::toRealDuration(Duration_t gameDuration, Duration_t& realDuration) const
+{
+  if(_isPaused || _scale <= 0.f)
+    return false;
+  realDuration = Duration_t{static_cast<int64_t>(gameDuration.count() / _scale)};
+  return true;
+}
+
 Engine::Ticker::Ticker(Callback_t onTick, Engine* tickCtx, Duration_t tickPeriod, 
                        int maxTicksPerFrame, bool isChasingGameNow) :
   _onTick{onTick},
@@ -44,6 +60,7 @@ Engine::Ticker::Ticker(Callback_t onTick, Engine* tickCtx, Duration_t tickPeriod
   _maxTicksPerFrame{maxTicksPerFrame},
   _ticksAccumulated{0},
   _isChasingGameNow{isChasingGameNow},
+  _tickAlpha{0.f},
   _isNewTickFrequencySample{false}
 {
   for(int i = 0; i < FPS_HISTORY_SIZE - 1; ++i)
@@ -70,6 +87,13 @@ void Engine::Ticker::doTicks(Duration_t gameNow, Duration_t realNow)
   _ticksDoneThisHalfSecond += _ticksDoneThisFrame;
   _ticksDoneTotal += _ticksDoneThisFrame;
 
+  //
+  // Ticks still accumulated have not been done so the last tick done is behind the ticker now.
+  //
+  Duration_t lastTickNow = _tickerNow - (_tickPeriod * _ticksAccumulated);
+  double alpha = static_cast<double>((now - lastTickNow).count()) / _tickPeriod.count();
+  _tickAlpha = static_cast<float>(std::clamp(alpha, 0.0, 1.0));
+
   _isNewTickFrequencySample = false;
   if((realNow - _lastMeasureNow) >= oneHalfSecond){
     double freqSample = (static_cast<double>(_ticksDoneThisHalfSecond) / 
@@ -86,6 +110,31 @@ void Engine::Ticker::doTicks(Duration_t gameNow, Duration_t realNow)
   }
 }
 
+//
+// A tick is done once the 'now' passed to doTicks exceeds the ticker now by a period, thus the
+// extra nanosecond. Accumulated ticks are due immediately.
+//
+Engine::Duration_t Engine::Ticker::getTimeToNextTick(Duration_t now) const
+{
+  if(_ticksAccumulated > 0)
+    return Duration_t::zero();
+  return std::max(Duration_t::zero(), (_tickerNow + _tickPeriod + Duration_t{1}) - now);
+}
+
+//
+// Moves the ticker now to the last tick due at 'now' without doing the ticks due, dropping
+// any ticks accumulated.
+//
+void Engine::Ticker::skipBacklog(Duration_t gameNow, Duration_t realNow)
+{
+  Duration_t now = _isChasingGameNow ? gameNow : realNow;
+  if(now > _tickerNow)
+    _tickerNow += _tickPeriod * ((now - _tickerNow - Duration_t{1}) / _tickPeriod);
+  _ticksAccumulated = 0;
+  _ticksDoneThisHalfSecond = 0;
+  _lastMeasureNow = realNow;
+}
+
 void Engine::Ticker::reset()
 {
   _tickerNow = Duration_t::zero();
@@ -94,17 +143,210 @@ void Engine::Ticker::reset()
   _ticksDoneThisHalfSecond = 0;
   _ticksDoneThisFrame = 0;
   _ticksAccumulated = 0;
+  _tickAlpha = 0.f;
+}
+
+void Engine::FramePacer::waitUntil(TimePoint_t deadline)
+{
+  auto now = Clock_t::now();
+  if(now >= deadline)
+    return;
+
+  if(deadline - now > _spinMargin){
+    TimePoint_t sleepEnd = deadline - _spinMargin;
+    std::this_thread::sleep_until(sleepEnd);
+
+    Duration_t oversleep = Clock_t::now() - sleepEnd;
+    _oversleepSum += oversleep;
+    _oversleepMax = std::max(_oversleepMax, oversleep);
+    ++_sleepCount;
+    if(oversleep > _spinMargin)
+      ++_lateSleepCount;
+  }
+
+  while((now = Clock_t::now()) < deadline)
+    ;
+
+  Duration_t wakeError = now - deadline;
+  _wakeErrorSum += wakeError;
+  _wakeErrorMax = std::max(_wakeErrorMax, wakeError);
+  ++_wakeCount;
+}
+
+Engine::Duration_t Engine::FramePacer::getMeanWakeError() const
+{
+  return _wakeCount > 0 ? _wakeErrorSum / _wakeCount : Duration_t::zero();
+}
+
+Engine::Duration_t Engine::FramePacer::getMeanOversleep() const
+{
+  return _sleepCount > 0 ? _oversleepSum / _sleepCount : Duration_t::zero();
+}
+
+void Engine::FramePacer::resetWakeStats()
+{
+  _wakeErrorSum = Duration_t::zero();
+  _wakeErrorMax = Duration_t::zero();
+  _wakeCount = 0;
+  _oversleepSum = Duration_t::zero();
+  _oversleepMax = Duration_t::zero();
+  _sleepCount = 0;
+  _lateSleepCount = 0;
+}
+
+Engine::FrameHistory::FrameHistory()
+{
+  reset();
+}
+
+void Engine::FrameHistory::record(const FrameSample_t& sample)
+{
+  int64_t head = _writesDone.load(std::memory_order_relaxed);
+  auto& slot = _samples[head % FRAME_HISTORY_SIZE];
+  bool isFull = head >= FRAME_HISTORY_SIZE;
+
+  _writesBegun.store(head + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  FrameSample_t evicted {};
+  for(int stage = 0; stage < FRAME_STAGE_COUNT; ++stage){
+    if(isFull){
+      evicted[stage] = Duration_t{slot[stage].load(std::memory_order_relaxed)};
+      --_histograms[stage][toBucket(evicted[stage])];
+    }
+    slot[stage].store(sample[stage].count(), std::memory_order_relaxed);
+    ++_histograms[stage][toBucket(sample[stage])];
+  }
+
+  _writesDone.store(head + 1, std::memory_order_release);
+
+  //
+  // The max only needs a scan of the ring when the max itself leaves the ring.
+  //
+  for(int stage = 0; stage < FRAME_STAGE_COUNT; ++stage){
+    if(sample[stage] >= _maxes[stage])
+      _maxes[stage] = sample[stage];
+    else if(isFull && evicted[stage] == _maxes[stage])
+      _maxes[stage] = findMax(static_cast<FrameStage>(stage));
+  }
+}
+
+void Engine::FrameHistory::reset()
+{
+  for(auto& slot : _samples)
+    for(auto& duration : slot)
+      duration.store(0, std::memory_order_relaxed);
+  for(auto& histogram : _histograms)
+    histogram.fill(0);
+  _maxes.fill(Duration_t::zero());
+  _writesBegun.store(0, std::memory_order_relaxed);
+  _writesDone.store(0, std::memory_order_release);
+}
+
+bool Engine::FrameHistory::getSample(int age, FrameSample_t& sample) const
+{
+  int64_t head = _writesDone.load(std::memory_order_acquire);
+  if(age < 0 || age >= std::min<int64_t>(head, FRAME_HISTORY_SIZE))
+    return false;
+
+  int64_t sequence = head - 1 - age;
+  const auto& slot = _samples[sequence % FRAME_HISTORY_SIZE];
+  for(int stage = 0; stage < FRAME_STAGE_COUNT; ++stage)
+    sample[stage] = Duration_t{slot[stage].load(std::memory_order_relaxed)};
+
+  //
+  // The slot is overwritten by the write which begins once FRAME_HISTORY_SIZE more writes
+  // have begun since the sample's own write.
+  //
+  std::atomic_thread_fence(std::memory_order_acquire);
+  return _writesBegun.load(std::memory_order_relaxed) <= sequence + FRAME_HISTORY_SIZE;
+}
+
+int Engine::FrameHistory::getSampleCount() const
+{
+  return std::min<int64_t>(_writesDone.load(std::memory_order_acquire), FRAME_HISTORY_SIZE);
+}
+
+//
+// Nearest-rank percentiles; each is reported as the upper bound of its bucket, capped at the
+// max.
+//
+Engine::FramePercentiles Engine::FrameHistory::getPercentiles(FrameStage stage) const
+{
+  FramePercentiles percentiles {};
+  int count = getSampleCount();
+  if(count == 0)
+    return percentiles;
+
+  const auto& histogram = _histograms[stage];
+  Duration_t* targets[] {&percentiles._p50, &percentiles._p95, &percentiles._p99};
+  const double ranks[] {0.50, 0.95, 0.99};
+
+  int target {0}, cumulative {0};
+  for(int bucket = 0; bucket < BUCKET_COUNT && target < 3; ++bucket){
+    cumulative += histogram[bucket];
+    while(target < 3 && cumulative >= std::ceil(ranks[target] * count)){
+      *targets[target] = std::min(BUCKET_WIDTH * (bucket + 1), _maxes[stage]);
+      ++target;
+    }
+  }
+
+  percentiles._max = _maxes[stage];
+  return percentiles;
+}
+
+int Engine::FrameHistory::toBucket(Duration_t d) const
+{
+  return std::clamp(static_cast<int>(d / BUCKET_WIDTH), 0, BUCKET_COUNT - 1);
+}
+
+Engine::Duration_t Engine::FrameHistory::findMax(FrameStage stage) const
+{
+  Duration_t max {Duration_t::zero()};
+  for(int i = 0; i < getSampleCount(); ++i)
+    max = std::max(max, Duration_t{_samples[i][stage].load(std::memory_order_relaxed)});
+  return max;
+}
+
+//
+// The gfx backend is taken from the rc unless overriden by the PXR_GFX_BACKEND environment
+// variable; useful to run headless benchmarks without editing the rc.
+//
+gfx::Backend Engine::selectGfxBackend()
+{
+  auto backend = static_cast<gfx::Backend>(_rc.getIntValue(EngineRC::KEY_GFX_BACKEND));
+  const char* env = std::getenv("PXR_GFX_BACKEND");
+  if(env == nullptr)
+    return backend;
+
+  std::string value {env};
+  if(value == "opengl")
+    return gfx::Backend::OPENGL;
+  if(value == "headless")
+    return gfx::Backend::HEADLESS;
+
+  log::log(log::WARN, log::msg_eng_invalid_gfx_backend_env, value);
+  return backend;
 }
 
 void Engine::initialize(std::unique_ptr<App> app)
 {
   log::initialize();
   input::initialize();
+  profile::setThreadName("main");
 
   if(!_rc.load(EngineRC::filename))
     _rc.write(EngineRC::filename);    // generate a default rc file if one doesn't exist.
 
-  if(SDL_Init(SDL_INIT_VIDEO) < 0){
+  jobs::initialize(_rc.getIntValue(EngineRC::KEY_JOB_WORKERS));
+
+  gfx::Backend gfxBackend = selectGfxBackend();
+
+  //
+  // Headless runs need no display; events are still initialized so the main loop can poll.
+  //
+  uint32_t sdlFlags = (gfxBackend == gfx::Backend::HEADLESS) ? SDL_INIT_EVENTS | SDL_INIT_TIMER : SDL_INIT_VIDEO;
+  if(SDL_Init(sdlFlags) < 0){
     log::log(log::FATAL, log::msg_eng_fail_sdl_init, std::string{SDL_GetError()});
     exit(EXIT_FAILURE);
   }
@@ -127,11 +369,14 @@ void Engine::initialize(std::unique_ptr<App> app)
   windowSize._x = _rc.getIntValue(EngineRC::KEY_WINDOW_WIDTH);
   windowSize._y = _rc.getIntValue(EngineRC::KEY_WINDOW_HEIGHT);
   bool fullscreen = _rc.getBoolValue(EngineRC::KEY_FULLSCREEN);
-  if(!gfx::initialize(ss.str(), windowSize, fullscreen)){
+  auto presentMode = static_cast<gfx::PresentMode>(_rc.getIntValue(EngineRC::KEY_PRESENT_MODE));
+  if(!gfx::initialize(ss.str(), windowSize, fullscreen, presentMode, gfxBackend)){
     log::log(log::FATAL, log::msg_gfx_fail_init);
     exit(EXIT_FAILURE);
   }
 
+  gfx::setRasterThreadCount(_rc.getIntValue(EngineRC::KEY_RASTER_THREADS));
+
   _engineFontKey = gfx::loadFont(engineFontName);
   
   if(!_app->onInit()){
@@ -150,8 +395,20 @@ void Engine::initialize(std::unique_ptr<App> app)
   Duration_t tickPeriod {static_cast<int64_t>(1.0e9 / static_cast<double>(_fpsLockHz))};
   log::log(log::INFO, log::msg_eng_locking_fps, std::to_string(_fpsLockHz) + "hz");
 
+  Duration_t drawTickPeriod {tickPeriod};
+  int drawFpsLockHz = _rc.getIntValue(EngineRC::KEY_DRAW_FPS_LOCK);
+  if(drawFpsLockHz != 0){
+    drawTickPeriod = Duration_t{static_cast<int64_t>(1.0e9 / static_cast<double>(drawFpsLockHz))};
+    log::log(log::INFO, log::msg_eng_locking_draw_fps, std::to_string(drawFpsLockHz) + "hz");
+  }
+
   _updateTicker = Ticker{&Engine::onSplashUpdateTick, this, tickPeriod, 1, true};
-  _drawTicker = Ticker{&Engine::onSplashDrawTick, this, tickPeriod, 1, false};
+  _drawTicker = Ticker{&Engine::onSplashDrawTick, this, drawTickPeriod, 1, false};
+  _targetFramePeriod = drawTickPeriod;
+
+  Duration_t spinMargin = oneMicrosecond * _rc.getIntValue(EngineRC::KEY_PACER_SPIN_MARGIN);
+  _pacer.setSpinMargin(spinMargin);
+  _updatePacer.setSpinMargin(spinMargin);
 
   _splashSoundKey = sfx::loadSound(splashName);
   _splashSpriteKey = gfx::loadSpritesheet(splashName);
@@ -184,7 +441,29 @@ void Engine::initialize(std::unique_ptr<App> app)
   _framesDoneThisSecond = 0;
   _measuredFrameFrequency = 0;
   _lastFrameMeasureNow = Duration_t::zero();
+  _lastFrameEnd = Clock_t::now();
+  _frameUpdateTime = Duration_t::zero();
+  _framePresentTime = Duration_t::zero();
   _isDrawingEngineStats = false;
+  _isUpdateThreaded = false;
+  _droppedKeyEvents = 0;
+  _isFastForwarding = false;
+  _isWindowFocused = true;
+  _isIdle = false;
+  _needIdleRedraw = false;
+  _lastCpuMeasureNow = Duration_t::zero();
+  _lastCpuClock = std::clock();
+  _measuredCpuUsage = 0.f;
+
+  _lastFrameAllocStats = alloc::getStats();
+  _maxFrameAllocs = 0;
+  _maxFrameAllocBytes = 0;
+  _isAssertingNoFrameAllocs = _rc.getBoolValue(EngineRC::KEY_ASSERT_NO_FRAME_ALLOCS);
+  _allocWarmupEndFrame = std::numeric_limits<long>::max();
+  if(_isAssertingNoFrameAllocs && !alloc::isTracking){
+    log::log(log::WARN, log::msg_eng_no_alloc_tracking);
+    _isAssertingNoFrameAllocs = false;
+  }
   _isDone = false;
 }
 
@@ -193,11 +472,17 @@ void Engine::shutdown()
   _app->onShutdown();
   gfx::shutdown();
   sfx::shutdown();
+  jobs::shutdown();
   log::shutdown();
 }
 
 void Engine::run()
 {
+  if(_rc.getIntValue(EngineRC::KEY_FAST_FORWARD_TICKS) > 0){
+    fastForward();
+    return;
+  }
+
   _realClock.reset();
   while(!_isSplashDone) 
     mainloop();
@@ -206,75 +491,454 @@ void Engine::run()
   _gameClock.reset();
   _updateTicker.reset();
   _drawTicker.reset();
+  _frameHistory.reset();
+  _lastFrameEnd = Clock_t::now();
+  _frameUpdateTime = Duration_t::zero();
+  _allocWarmupEndFrame = _framesDone + allocWarmupFrames;
+  _lastCpuMeasureNow = Duration_t::zero();
+  _lastCpuClock = std::clock();
+  updateIdle();
+  startInputReplay();
+  startUpdateThread();
   while(!_isDone) 
     mainloop();
+  stopUpdateThread();
+  stopInputReplay();
 }
 
-void Engine::mainloop()
+//
+// Recording and replay start with the main loop so ticks are counted from the same point in 
+// both; see input::startRecording.
+//
+void Engine::startInputReplay()
+{
+  switch(_rc.getIntValue(EngineRC::KEY_INPUT_REPLAY)){
+    case 1:
+      input::startRecording();
+      break;
+    case 2:
+      input::startReplay();
+      break;
+    default:
+      break;
+  }
+}
+
+void Engine::stopInputReplay()
 {
-  auto frameStart = Clock_t::now();
+  if(input::isRecording())
+    input::stopRecording();
+  else if(input::isReplaying())
+    input::stopReplay();
+}
 
-  _gameClock.update(_realClock.update()); 
-  auto gameNow = _gameClock.getNow();
-  auto realNow = _realClock.getNow();
+//
+// Runs a fixed number of update ticks as fast as possible, advancing the game clock by exactly
+// one tick period per tick rather than with the real clock, so a run is independent of the
+// speed of the machine; drawing every n'th tick if configured to. Used to soak test and 
+// benchmark app logic. The splash screen, the pacer and the update thread are all skipped, and 
+// the throughput is logged at the end.
+//
+void Engine::fastForward()
+{
+  if(!_isSplashDone)
+    onSplashExit();
 
-  SDL_Event event;
-  while(SDL_PollEvent(&event) != 0){
-    switch(event.type){
-      case SDL_QUIT:
-        _isSplashDone = true;
-        _isDone = true;
+  int tickCount = _rc.getIntValue(EngineRC::KEY_FAST_FORWARD_TICKS);
+  int drawEvery = _rc.getIntValue(EngineRC::KEY_FAST_FORWARD_DRAW_EVERY);
+  Duration_t tickPeriod = _updateTicker.getTickPeriod();
+  float tickPeriodSeconds = _updateTicker.getTickPeriodSeconds();
+
+  log::log(log::INFO, log::msg_eng_fast_forwarding, 
+           "ticks=" + std::to_string(tickCount) + " drawEvery=" + std::to_string(drawEvery));
+
+  _realClock.reset();
+  _gameClock.reset();
+  startInputReplay();
+  _isFastForwarding = true;
+
+  //
+  // Events are polled only periodically as polling costs more than many app ticks; often 
+  // enough to notice a quit.
+  //
+  static constexpr int ticksPerPoll {256};
+
+  int ticksDone {0};
+  int drawsDone {0};
+  auto start = Clock_t::now();
+  while(ticksDone < tickCount && !_isDone){
+    if(ticksDone % ticksPerPoll == 0){
+      SDL_Event event;
+      while(SDL_PollEvent(&event) != 0)
+        if(event.type == SDL_QUIT)
+          _isDone = true;
+    }
+
+    _gameClock.update(tickPeriod);
+    _realClock.update();
+    onUpdateTick(tickPeriodSeconds);
+    ++ticksDone;
+
+    if(drawEvery > 0 && ticksDone % drawEvery == 0){
+      onDrawTick(tickPeriodSeconds);
+      ++drawsDone;
+    }
+  }
+  Duration_t elapsed = Clock_t::now() - start;
+  _isFastForwarding = false;
+  _isDone = true;
+  stopInputReplay();
+
+  double seconds = durationToSeconds(elapsed);
+  double gameSeconds = durationToSeconds(_gameClock.getNow());
+  std::stringstream ss {};
+  ss << "ticks=" << ticksDone 
+     << " draws=" << drawsDone
+     << " seconds=" << seconds
+     << " ticksPerSecond=" << (seconds > 0.0 ? ticksDone / seconds : 0.0)
+     << " speedup=" << (seconds > 0.0 ? gameSeconds / seconds : 0.0) << "x";
+  log::log(log::INFO, log::msg_eng_fast_forward_done, ss.str());
+}
+
+void Engine::startUpdateThread()
+{
+  if(!_rc.getBoolValue(EngineRC::KEY_THREADED_UPDATE))
+    return;
+
+  if(!_app->hasSnapshots()){
+    log::log(log::WARN, log::msg_eng_no_app_snapshots);
+    return;
+  }
+
+  log::log(log::INFO, log::msg_eng_threaded_update);
+  _pendingKeyEvents.reserve(maxQueuedKeyEvents);
+  _keyEvents.reserve(maxQueuedKeyEvents);
+  _droppedKeyEvents = 0;
+  _isUpdateThreaded = true;
+  _isUpdateThreadStopping = false;
+  _updateThread = std::thread{&Engine::updateLoop, this};
+}
+
+void Engine::stopUpdateThread()
+{
+  if(!_isUpdateThreaded)
+    return;
+
+  {
+    std::lock_guard<std::mutex> lock {_idleMutex};
+    _isUpdateThreadStopping = true;
+  }
+  _idleWake.notify_all();
+  _updateThread.join();
+  _isUpdateThreaded = false;
+
+  if(_droppedKeyEvents > 0)
+    log::log(log::WARN, log::msg_eng_dropped_key_events, std::to_string(_droppedKeyEvents));
+}
+
+//
+// The loop of the update thread; the update thread equivalent of the mainloop.
+//
+void Engine::updateLoop()
+{
+  profile::setThreadName("update");
+
+  while(!_isUpdateThreadStopping){
+    bool isWarm = _updateTicker.getTicksDoneTotal() >= allocWarmupFrames;
+    alloc::ForbidScope forbidAllocs {_isAssertingNoFrameAllocs && isWarm};
+
+    if(_isIdle){
+      std::unique_lock<std::mutex> lock {_idleMutex};
+      _idleWake.wait(lock, [this]{return !_isIdle || _isUpdateThreadStopping;});
+      continue;
+    }
+
+    Duration_t gameNow, realNow;
+    TimePoint_t clocksNow = updateClocks(gameNow, realNow);
+    applyKeyEvents();
+    _updateTicker.doTicks(gameNow, realNow);
+
+    //
+    // Polls whilst the game clock is paused so as to notice the unpause.
+    //
+    Duration_t untilNextTick = std::min(getTimeToNextUpdateTick(gameNow), minFramePeriod);
+    _updatePacer.waitUntil(clocksNow + untilNextTick);
+  }
+}
+
+//
+// Returns the time point at which the clocks were read.
+//
+Engine::TimePoint_t Engine::updateClocks(Duration_t& gameNow, Duration_t& realNow)
+{
+  std::lock_guard<std::mutex> lock {_clockMutex};
+  _gameClock.update(_realClock.update());
+  gameNow = _gameClock.getNow();
+  realNow = _realClock.getNow();
+  return _realClock.getNowTimePoint();
+}
+
+//
+// The real time until the next update tick is due; a max duration if the game clock is stopped.
+//
+Engine::Duration_t Engine::getTimeToNextUpdateTick(Duration_t gameNow)
+{
+  Duration_t untilNextTick {Duration_t::max()};
+  std::lock_guard<std::mutex> lock {_clockMutex};
+  _gameClock.toRealDuration(_updateTicker.getTimeToNextTick(gameNow), untilNextTick);
+  return untilNextTick;
+}
+
+void Engine::readClocks(Duration_t& gameNow, Duration_t& realNow)
+{
+  std::lock_guard<std::mutex> lock {_clockMutex};
+  gameNow = _gameClock.getNow();
+  realNow = _realClock.getNow();
+}
+
+void Engine::forwardKeyEvent(const SDL_Event& event)
+{
+  if(!_isUpdateThreaded){
+    input::onKeyEvent(event);
+    return;
+  }
+  std::lock_guard<std::mutex> lock {_keyEventsMutex};
+  if(static_cast<int>(_pendingKeyEvents.size()) == maxQueuedKeyEvents){
+    ++_droppedKeyEvents;
+    return;
+  }
+  _pendingKeyEvents.push_back(event);
+}
+
+//
+// Called on the update thread to pass the key events queued by the main thread to the input
+// module.
+//
+void Engine::applyKeyEvents()
+{
+  {
+    std::lock_guard<std::mutex> lock {_keyEventsMutex};
+    _keyEvents.swap(_pendingKeyEvents);
+  }
+  for(const auto& event : _keyEvents)
+    input::onKeyEvent(event);
+  _keyEvents.clear();
+}
+
+void Engine::onEvent(const SDL_Event& event)
+{
+  switch(event.type){
+    case SDL_QUIT:
+      _isSplashDone = true;
+      _isDone = true;
+      return;
+    case SDL_WINDOWEVENT:
+      if(event.window.event == SDL_WINDOWEVENT_SIZE_CHANGED){
+        alloc::ForbidScope allowAllocs {false};
+        gfx::onWindowResize(Vector2i{event.window.data1, event.window.data2});
+        _needIdleRedraw = true;
+      }
+      else if(event.window.event == SDL_WINDOWEVENT_EXPOSED)
+        _needIdleRedraw = true;
+      else if(event.window.event == SDL_WINDOWEVENT_FOCUS_GAINED){
+        _isWindowFocused = true;
+        updateIdle();
+      }
+      else if(event.window.event == SDL_WINDOWEVENT_FOCUS_LOST){
+        _isWindowFocused = false;
+        updateIdle();
+      }
+      return;
+    case SDL_KEYDOWN:
+      if(event.key.keysym.sym == decrementGameClockScaleKey){
+        std::lock_guard<std::mutex> lock {_clockMutex};
+        _gameClock.incrementScale(-0.1);
         return;
-      case SDL_WINDOWEVENT:
-        if(event.window.event == SDL_WINDOWEVENT_SIZE_CHANGED)
-          gfx::onWindowResize(Vector2i{event.window.data1, event.window.data2});
-        break;
-      case SDL_KEYDOWN:
-        if(event.key.keysym.sym == decrementGameClockScaleKey){
-          _gameClock.incrementScale(-0.1);
-          break;
-        }
-        else if(event.key.keysym.sym == incrementGameClockScaleKey){
-          _gameClock.incrementScale(0.1);
-          break;
-        }
-        else if(event.key.keysym.sym == resetGameClockScaleKey){
-          _gameClock.setScale(1.f);
-          break;
-        }
-        else if(event.key.keysym.sym == pauseGameClockKey){
-          if(!_isSplashDone)
-            continue;
+      }
+      else if(event.key.keysym.sym == incrementGameClockScaleKey){
+        std::lock_guard<std::mutex> lock {_clockMutex};
+        _gameClock.incrementScale(0.1);
+        return;
+      }
+      else if(event.key.keysym.sym == resetGameClockScaleKey){
+        std::lock_guard<std::mutex> lock {_clockMutex};
+        _gameClock.setScale(1.f);
+        return;
+      }
+      else if(event.key.keysym.sym == pauseGameClockKey){
+        if(!_isSplashDone)
+          return;
+        bool isPaused;
+        {
+          std::lock_guard<std::mutex> lock {_clockMutex};
           _gameClock.togglePause();
-          if(_gameClock.isPaused())
-            gfx::enableScreen(_pauseScreenId);
-          else
-            gfx::disableScreen(_pauseScreenId);
-          break;
-        }
-        else if(event.key.keysym.sym == toggleDrawEngineStatsKey){
-          _isDrawingEngineStats = !_isDrawingEngineStats;
-          if(!_isDrawingEngineStats)
-            gfx::disableScreen(_statsScreenId);
-          else
-            gfx::enableScreen(_statsScreenId);
-          break;
-        }
-        else if(event.key.keysym.sym == skipSplashKey && !_isSplashDone){
-          onSplashExit(); 
-          break;
+          isPaused = _gameClock.isPaused();
         }
-        // FALLTHROUGH
-      case SDL_KEYUP:
-        input::onKeyEvent(event);
-        break;
-    }
+        if(isPaused)
+          gfx::enableScreen(_pauseScreenId);
+        else
+          gfx::disableScreen(_pauseScreenId);
+        _needIdleRedraw = true;
+        updateIdle();
+        return;
+      }
+      else if(event.key.keysym.sym == toggleDrawEngineStatsKey){
+        _isDrawingEngineStats = !_isDrawingEngineStats;
+        if(!_isDrawingEngineStats)
+          gfx::disableScreen(_statsScreenId);
+        else
+          gfx::enableScreen(_statsScreenId);
+        _needRedrawEngineStats = true;
+        _needIdleRedraw = true;
+        return;
+      }
+      else if(event.key.keysym.sym == writeProfileTraceKey){
+        alloc::ForbidScope allowAllocs {false};
+        profile::writeTrace();
+        return;
+      }
+      else if(event.key.keysym.sym == skipSplashKey && !_isSplashDone){
+        onSplashExit(); 
+        return;
+      }
+      // FALLTHROUGH
+    case SDL_KEYUP:
+      forwardKeyEvent(event);
+      return;
+  }
+}
+
+//
+// The engine idles whilst the game clock is paused or the window is unfocused, in which case
+// the game cannot progress and the player is not watching (nor is the window on the headless
+// backend, which is never unfocused).
+//
+void Engine::updateIdle()
+{
+  bool isIdle = _isSplashDone && (!_isWindowFocused || _gameClock.isPaused());
+  if(isIdle == _isIdle)
+    return;
+
+  {
+    std::lock_guard<std::mutex> lock {_idleMutex};
+    _isIdle = isIdle;
+  }
+  _idleWake.notify_all();
+
+  if(isIdle){
+    _needIdleRedraw = true;
+    return;
+  }
+
+  //
+  // The clocks were held whilst idle, so the next frame sees little time pass, and ticks due
+  // during the idle are dropped rather than done in a burst.
+  //
+  Duration_t gameNow, realNow;
+  {
+    std::lock_guard<std::mutex> lock {_clockMutex};
+    _realClock.update();
+    gameNow = _gameClock.getNow();
+    realNow = _realClock.getNow();
+  }
+  _drawTicker.skipBacklog(gameNow, realNow);
+  if(!_isUpdateThreaded)
+    _updateTicker.skipBacklog(gameNow, realNow);
+  _lastFrameEnd = Clock_t::now();
+  _frameUpdateTime = Duration_t::zero();
+}
+
+//
+// The idle equivalent of the mainloop. Blocks on events rather than polling, does no ticks and 
+// redraws only when something visible changed, e.g. the pause dialog was toggled or a stats 
+// sample is due. Only the real clock advances so the game clock cannot accumulate update ticks.
+//
+void Engine::idle()
+{
+  Duration_t realNow;
+  {
+    std::lock_guard<std::mutex> lock {_clockMutex};
+    _realClock.update();
+    realNow = _realClock.getNow();
+  }
+
+  if(measureCpuUsage(realNow))
+    _needRedrawEngineStats = true;
+
+  if(_isDrawingEngineStats && _needRedrawEngineStats)
+    _needIdleRedraw = true;
+
+  if(_needIdleRedraw){
+    onDrawTick(_drawTicker.getTickPeriodSeconds());
+    _needIdleRedraw = false;
   }
 
-  _updateTicker.doTicks(gameNow, realNow);
+  SDL_Event event;
+  int timeoutMs = static_cast<int>(durationToMilliseconds(idleWakePeriod));
+  if(SDL_WaitEventTimeout(&event, timeoutMs) == 0)
+    return;
+
+  do{
+    onEvent(event);
+    if(_isDone || !_isIdle)
+      return;
+  }
+  while(SDL_PollEvent(&event) != 0);
+}
+
+//
+// Measures the cpu time used by the process, over all threads, as a percentage of one core 
+// every half second. Returns true if a new measurement was taken.
+//
+bool Engine::measureCpuUsage(Duration_t realNow)
+{
+  if((realNow - _lastCpuMeasureNow) < oneHalfSecond)
+    return false;
+
+  std::clock_t cpuNow = std::clock();
+  double cpuSeconds = static_cast<double>(cpuNow - _lastCpuClock) / CLOCKS_PER_SEC;
+  _measuredCpuUsage = 100.0 * cpuSeconds / durationToSeconds(realNow - _lastCpuMeasureNow);
+  _lastCpuClock = cpuNow;
+  _lastCpuMeasureNow = realNow;
+  return true;
+}
+
+void Engine::mainloop()
+{
+  PXR_PROFILE_SCOPE("Engine::mainloop");
+
+  alloc::ForbidScope forbidAllocs {_isAssertingNoFrameAllocs && _framesDone >= _allocWarmupEndFrame};
+
+  if(_isIdle){
+    idle();
+    return;
+  }
+
+  Duration_t gameNow, realNow;
+  TimePoint_t clocksNow = updateClocks(gameNow, realNow);
+
+  SDL_Event event;
+  while(SDL_PollEvent(&event) != 0){
+    onEvent(event);
+    if(_isDone || _isIdle)
+      return;
+  }
+
+  auto updateStart = Clock_t::now();
+  if(!_isUpdateThreaded)
+    _updateTicker.doTicks(gameNow, realNow);
+  auto drawStart = Clock_t::now();
   _drawTicker.doTicks(gameNow, realNow);
+  auto drawEnd = Clock_t::now();
 
-  if(_updateTicker.isNewTickFrequencySample() || _drawTicker.isNewTickFrequencySample())
+  _frameUpdateTime += drawStart - updateStart;
+  if(_drawTicker.getTicksDoneThisFrame() > 0)
+    recordFrame(drawEnd - drawStart - _framePresentTime);
+
+  bool isNewUpdateSample = !_isUpdateThreaded && _updateTicker.isNewTickFrequencySample();
+  if(isNewUpdateSample || _drawTicker.isNewTickFrequencySample())
+    _needRedrawEngineStats = true;
+  if(measureCpuUsage(realNow))
     _needRedrawEngineStats = true;
 
   ++_framesDone;
@@ -287,9 +951,66 @@ void Engine::mainloop()
     _framesDoneThisSecond = 0;
   }
 
-  auto framePeriod = Clock_t::now() - frameStart;
-  if(framePeriod < minFramePeriod)
-    std::this_thread::sleep_for(minFramePeriod - framePeriod); 
+  //
+  // The loop has nothing to do until the next tick so waits for it.
+  //
+  Duration_t untilNextTick = _drawTicker.getTimeToNextTick(realNow);
+  if(!_isUpdateThreaded)
+    untilNextTick = std::min(untilNextTick, getTimeToNextUpdateTick(gameNow));
+  _pacer.waitUntil(clocksNow + untilNextTick);
+}
+
+void Engine::recordFrame(Duration_t drawTime)
+{
+  auto frameEnd = Clock_t::now();
+
+  FrameSample_t sample {};
+  sample[FRAME_STAGE_WALL] = frameEnd - _lastFrameEnd;
+  sample[FRAME_STAGE_UPDATE] = _frameUpdateTime;
+  sample[FRAME_STAGE_DRAW] = drawTime;
+  sample[FRAME_STAGE_PRESENT] = _framePresentTime;
+  _frameHistory.record(sample);
+
+  _lastFrameEnd = frameEnd;
+  _frameUpdateTime = Duration_t::zero();
+
+  //
+  // Counts all threads, e.g. include those of a threaded update.
+  //
+  alloc::AllocStats allocStats = alloc::getStats();
+  _maxFrameAllocs = std::max(_maxFrameAllocs, allocStats._allocs - _lastFrameAllocStats._allocs);
+  _maxFrameAllocBytes = std::max(_maxFrameAllocBytes, allocStats._bytes - _lastFrameAllocStats._bytes);
+  _lastFrameAllocStats = allocStats;
+}
+
+//
+// Plots the wall time of the most recent frames as bars, newest on the right. The graph spans
+// twice the target frame period; the line across the middle marks the target period. Frames 
+// which took over 1.5 target periods (i.e. missed a draw tick) are drawn red.
+//
+void Engine::drawFrameGraph()
+{
+  const iRect& bounds = frameGraphBounds;
+  int xmax = bounds._x + bounds._w - 1;
+  int ymax = bounds._y + bounds._h - 1;
+  Duration_t graphPeriod = _targetFramePeriod * 2;
+
+  gfx::drawBorderRectangle(bounds, gfx::colors::davysgray, _statsScreenId);
+  gfx::drawLine({bounds._x, bounds._y + (bounds._h / 2)}, {xmax, bounds._y + (bounds._h / 2)}, 
+                gfx::colors::dimgray, _statsScreenId);
+
+  FrameSample_t sample {};
+  int barCount = std::min(_frameHistory.getSampleCount(), bounds._w);
+  for(int age = 0; age < barCount; ++age){
+    if(!_frameHistory.getSample(age, sample))
+      break;
+    Duration_t wall = std::min(sample[FRAME_STAGE_WALL], graphPeriod);
+    int barHeight = static_cast<int>((wall * bounds._h) / graphPeriod);
+    if(barHeight == 0)
+      continue;
+    gfx::Color4u color = (sample[FRAME_STAGE_WALL] * 2 > _targetFramePeriod * 3) ? gfx::colors::red : gfx::colors::green;
+    gfx::drawLine({xmax - age, bounds._y}, {xmax - age, std::min(bounds._y + barHeight - 1, ymax)}, color, _statsScreenId);
+  }
 }
 
 void Engine::drawEngineStats()
@@ -299,27 +1020,78 @@ void Engine::drawEngineStats()
 
   gfx::clearScreenShade(1, _statsScreenId);
 
-  const auto& updateHistory = _updateTicker.getTickFrequencyHistory();
-  const auto& drawHistory = _drawTicker.getTickFrequencyHistory();
+  drawFrameGraph();
+
+  char line[128];
+
+  std::snprintf(line, sizeof(line), "pacer wake error [us] -- mean=%lld max=%lld spin margin=%lld",
+                static_cast<long long>(_pacer.getMeanWakeError() / oneMicrosecond),
+                static_cast<long long>(_pacer.getMaxWakeError() / oneMicrosecond),
+                static_cast<long long>(_pacer.getSpinMargin() / oneMicrosecond));
+  gfx::drawText({10, 40}, line, _engineFontKey, _statsScreenId);
+
+  std::snprintf(line, sizeof(line), "pacer oversleep [us] -- mean=%lld max=%lld late sleeps=%d/%d",
+                static_cast<long long>(_pacer.getMeanOversleep() / oneMicrosecond),
+                static_cast<long long>(_pacer.getMaxOversleep() / oneMicrosecond),
+                _pacer.getLateSleepCount(), _pacer.getSleepCount());
+  gfx::drawText({10, 100}, line, _engineFontKey, _statsScreenId);
+  _pacer.resetWakeStats();
+
+  std::snprintf(line, sizeof(line), "%-8s%8s%8s%8s%8s    frame FPS: %.3ghz", 
+                "[ms]", "p50", "p95", "p99", "max", _measuredFrameFrequency);
+  gfx::drawText({10, 90}, line, _engineFontKey, _statsScreenId);
+
+  static constexpr const char* stageNames[FRAME_STAGE_COUNT] {"wall", "update", "draw", "present"};
+  for(int stage = 0; stage < FRAME_STAGE_COUNT; ++stage){
+    FramePercentiles percentiles = _frameHistory.getPercentiles(static_cast<FrameStage>(stage));
+    std::snprintf(line, sizeof(line), "%-8s%8.2f%8.2f%8.2f%8.2f", stageNames[stage],
+                  durationToMilliseconds(percentiles._p50),
+                  durationToMilliseconds(percentiles._p95),
+                  durationToMilliseconds(percentiles._p99),
+                  durationToMilliseconds(percentiles._max));
+    gfx::drawText({10, 80 - (stage * 10)}, line, _engineFontKey, _statsScreenId);
+  }
 
-  std::stringstream ss{};
+  //
+  // The allocations per frame are drawn right of the stage percentiles.
+  //
+  if(alloc::isTracking){
+    gfx::drawText({340, 80}, "allocs/frame max", _engineFontKey, _statsScreenId);
+    std::snprintf(line, sizeof(line), "count=%lld", static_cast<long long>(_maxFrameAllocs));
+    gfx::drawText({340, 70}, line, _engineFontKey, _statsScreenId);
+    std::snprintf(line, sizeof(line), "bytes=%lld", static_cast<long long>(_maxFrameAllocBytes));
+    gfx::drawText({340, 60}, line, _engineFontKey, _statsScreenId);
+    _maxFrameAllocs = 0;
+    _maxFrameAllocBytes = 0;
+  }
 
-  ss << std::setprecision(3);
-  ss << "update FPS: " << updateHistory[Ticker::FPS_HISTORY_SIZE - 1] << "hz  "
-     << "render FPS: " << drawHistory[Ticker::FPS_HISTORY_SIZE - 1] << "hz  "
-     << "frame FPS: " << _measuredFrameFrequency << "hz";
-  gfx::drawText({10, 20}, ss.str(), _engineFontKey, _statsScreenId);
+  std::snprintf(line, sizeof(line), "cpu=%.3g%%%s", _measuredCpuUsage, _isIdle ? " idle" : "");
+  gfx::drawText({340, 50}, line, _engineFontKey, _statsScreenId);
 
-  std::stringstream().swap(ss);
+  Duration_t gameNow, realNow;
+  readClocks(gameNow, realNow);
 
   int gameHours, gameMins, gameSecs, realHours, realMins, realSecs;
-  durationToDigitalClock(_gameClock.getNow(), gameHours, gameMins, gameSecs);
-  durationToDigitalClock(_realClock.getNow(), realHours, realMins, realSecs);
-
-  ss << std::setprecision(3);
-  ss << "time [h:m:s] -- game=" << gameHours << ":" << gameMins << ":" << gameSecs
-                 << " -- real=" << realHours << ":" << realMins << ":" << realSecs;
-  gfx::drawText({10, 10}, ss.str(), _engineFontKey, _statsScreenId);
+  durationToDigitalClock(gameNow, gameHours, gameMins, gameSecs);
+  durationToDigitalClock(realNow, realHours, realMins, realSecs);
+
+  std::snprintf(line, sizeof(line), "time [h:m:s] -- game=%d:%d:%d -- real=%d:%d:%d",
+                gameHours, gameMins, gameSecs, realHours, realMins, realSecs);
+  gfx::drawText({10, 10}, line, _engineFontKey, _statsScreenId);
+
+  const auto& presentStats = gfx::getPresentStats();
+  std::snprintf(line, sizeof(line), "present px -- dirty=%d uploaded=%d total=%d screens=%d/%d",
+                presentStats._pxDirty, presentStats._pxUploaded, presentStats._pxPresented,
+                presentStats._screensUploaded, presentStats._screensPresented);
+  gfx::drawText({10, 20}, line, _engineFontKey, _statsScreenId);
+
+  const auto& textStats = gfx::getTextRunCacheStats();
+  int64_t textLookups = textStats._hits + textStats._misses;
+  double textHitRate = textLookups > 0 ? (100.0 * textStats._hits) / textLookups : 0.0;
+  std::snprintf(line, sizeof(line), "text cache -- hits=%lld misses=%lld rate=%.3g%% entries=%d",
+                static_cast<long long>(textStats._hits), static_cast<long long>(textStats._misses),
+                textHitRate, textStats._entries);
+  gfx::drawText({10, 30}, line, _engineFontKey, _statsScreenId);
 
   _needRedrawEngineStats = false;
 }
@@ -333,10 +1105,8 @@ void Engine::drawPauseDialog()
   int xmax = pauseScreenResolution._x - 1;
   int ymax = pauseScreenResolution._y - 1;
 
-  gfx::drawLine(Vector2i{0, 0}, Vector2i{0, ymax}, gfx::colors::barbiepink, _pauseScreenId);
-  gfx::drawLine(Vector2i{0, 0}, Vector2i{xmax, 0}, gfx::colors::barbiepink, _pauseScreenId);
-  gfx::drawLine(Vector2i{0, ymax}, Vector2i{xmax, ymax}, gfx::colors::barbiepink, _pauseScreenId);
-  gfx::drawLine(Vector2i{xmax, 0}, Vector2i{xmax, ymax}, gfx::colors::barbiepink, _pauseScreenId);
+  const Vector2i border[] {{0, 0}, {0, ymax}, {xmax, ymax}, {xmax, 0}};
+  gfx::drawPolyline(border, 4, gfx::colors::barbiepink, _pauseScreenId, true);
 
   Vector2i pausedTxtPos{};
   Vector2i pausedTxtBox = gfx::calculateTextSize(dialogTxt, _engineFontKey);
@@ -348,22 +1118,38 @@ void Engine::drawPauseDialog()
 
 void Engine::onUpdateTick(float tickPeriodSeconds)
 {
-  double nowSeconds = durationToSeconds(_gameClock.getNow());
+  PXR_PROFILE_SCOPE("Engine::onUpdateTick");
+
+  Duration_t gameNow, realNow;
+  readClocks(gameNow, realNow);
+
+  double nowSeconds = durationToSeconds(gameNow);
   _app->onUpdate(nowSeconds, tickPeriodSeconds);
   input::onUpdate();
+
+  if(_isUpdateThreaded)
+    _app->onSnapshot();
 }
 
 void Engine::onDrawTick(float tickPeriodSeconds)
 {
+  PXR_PROFILE_SCOPE("Engine::onDrawTick");
+
   gfx::clearWindowColor(gfx::colors::silver);
 
-  double nowSeconds = durationToSeconds(_gameClock.getNow());
-  _app->onDraw(nowSeconds, tickPeriodSeconds);
+  Duration_t gameNow, realNow;
+  readClocks(gameNow, realNow);
+
+  double nowSeconds = durationToSeconds(gameNow);
+  if(_isUpdateThreaded)
+    _app->onDrawSnapshot(nowSeconds, tickPeriodSeconds);
+  else
+    _app->onDraw(nowSeconds, tickPeriodSeconds, _isFastForwarding ? 1.f : _updateTicker.getTickAlpha());
 
   if(_isDrawingEngineStats)
     drawEngineStats();
 
-  gfx::present();
+  present();
 
 }
 
@@ -412,7 +1198,14 @@ void Engine::onSplashDrawTick(float tickPeriodSeconds)
   if(_isDrawingEngineStats)
     drawEngineStats();
 
+  present();
+}
+
+void Engine::present()
+{
+  auto presentStart = Clock_t::now();
   gfx::present();
+  _framePresentTime = Clock_t::now() - presentStart;
 }
 
 void Engine::onSplashExit()
@@ -5,10 +5,17 @@
 #include <map>
 #include <string>
 #include <cstring>
+#include <fstream>
+#include <bit>
 #include <sstream>
 #include <cinttypes>
+#include <cstdio>
 #include <limits>
 #include <cassert>
+#include <cmath>
+#include <utility>
+#include <type_traits>
+#include <string_view>
 
 #include <chrono>
 
@@ -18,6 +25,10 @@
 #include "pxr_rect.h"
 #include "pxr_color.h"
 #include "pxr_bmp.h"
+#include "pxr_blit.h"
+#include "pxr_handle.h"
+#include "pxr_profile.h"
+#include "pxr_jobs.h"
 #include "pxr_log.h"
 
 using namespace tinyxml2;
@@ -36,6 +47,8 @@ namespace gfx
 
 static constexpr int MIN_OPENGL_VERSION_MAJOR = 2;
 static constexpr int MIN_OPENGL_VERSION_MINOR = 1;
+static constexpr int MIN_GLSL_OPENGL_VERSION_MAJOR = 2;
+static constexpr int MIN_GLSL_OPENGL_VERSION_MINOR = 0;
 static constexpr int DEF_OPENGL_VERSION_MAJOR = 3;
 static constexpr int DEF_OPENGL_VERSION_MINOR = 0;
 
@@ -50,6 +63,235 @@ static SDL_Window* window;
 static SDL_GLContext glContext;
 static iRect viewport;
 static std::vector<Screen> screens;
+static PresentMode presentMode;
+static Backend backend;
+static PresentStats presentStats;
+
+//
+// A text string composited into opaque runs. Drawing a cached string costs the same as drawing
+// a sprite of the same size. 
+//
+struct TextRun
+{
+  bool _isLive;                        // false if the entry holds no string.
+  bool _isPinned;                      // true if drawn by a pending deferred draw.
+  uint64_t _lastUse;                   // the value of textRunUseClock when last found.
+  uint64_t _hash;                      // of the font key and text; see hashTextRunKey.
+  ResourceKey_t _fontKey;
+  std::string _text;
+  Vector2i _textSize;                  // the size of the string from its glyph metrics.
+  Vector2i _offset;                    // offset of the bottom-left of the runs from the draw position.
+  Vector2i _size;                      // size of the bounding box of the runs.
+  std::vector<SpriteRunRow> _runRows;  // one per row of the bounding box.
+  std::vector<SpriteRun> _runs;
+  std::vector<Color4u> _runPixels;
+  std::vector<PaletteIndex_t> _runIndices;  // empty unless _isPalette.
+  bool _isPalette;                         // true if the font was loaded for PALETTE8 screens.
+};
+
+//
+// The text run cache is a fixed pool of entries whose buffers are reserved upon initialization
+// and reused in place when an entry is evicted, so caching a string does not allocate unless
+// it exceeds the reserved capacities, in which case the buffers of its entry grow (once). 
+// The capacities fit strings whose bounding box is up to TEXT_RUN_RESERVE_PIXELS, e.g. 80
+// characters of an 8 pixel font.
+//
+// Entries are found by a linear search of their hashes, and the least recently used unpinned 
+// entry is evicted on a miss; the pool is small enough that searching is cheaper than 
+// maintaining an index. Entries drawn by pending deferred draws are pinned until rasterised.
+//
+static constexpr int TEXT_RUN_CACHE_CAPACITY = 64;
+static constexpr int TEXT_RUN_RESERVE_CHARS = 128;
+static constexpr int TEXT_RUN_RESERVE_ROWS = 64;
+static constexpr int TEXT_RUN_RESERVE_PIXELS = 8192;
+static constexpr int TEXT_RUN_RESERVE_RUNS = TEXT_RUN_RESERVE_PIXELS / 2;  // runs are separated by at least 1 pixel.
+
+static std::array<TextRun, TEXT_RUN_CACHE_CAPACITY> textRuns;
+static std::vector<Color4u> textRunScratch;  // the pixels of the string being baked.
+static uint64_t textRunUseClock;
+static TextRunCacheStats textRunCacheStats;
+
+enum class DrawCommandType
+{
+  CLEAR,
+  SPRITE,
+  SPRITE_COLUMN,
+  SPRITE_MASK,
+  TEXT,
+  BORDER_RECTANGLE,
+  FILL_RECTANGLE,
+  FILL_RECTANGLES,
+  LINE,
+  LINES,
+  POINT
+};
+
+//
+// A draw call recorded by a screen in DrawMode::DEFERRED. Positions and extents are stored
+// post-clamping, as they would be rasterised in immediate mode. Member use by type,
+//
+//      CLEAR            - _color
+//      SPRITE           - _sheet, _spriteid, _arg=mirror, _p0=bottom-left screen position
+//      SPRITE_COLUMN    - _sheet, _spriteid, _arg=column, _p0=draw position
+//      SPRITE_MASK      - _mask, _color=tint, _p0=bottom-left screen position
+//      TEXT             - _textRun, _p0=bottom-left screen position
+//      BORDER_RECTANGLE - _color, _p0=min corner, _p1=max corner
+//      FILL_RECTANGLE   - _color, _p0=min corner, _p1=max corner
+//      FILL_RECTANGLES  - _color, _arg=index of the first rect in the list's _rects, _count=rects
+//      LINE             - _color, _p0 and _p1=end points (clipped to the screen)
+//      LINES            - _color, _arg=index of the first end point in the list's _points,
+//                         _count=lines
+//      POINT            - _color, _p0=position
+//
+struct DrawCommand
+{
+  DrawCommandType    _type;
+  bool               _shader;
+  PXShader_t         _pxShader;
+  SpanShader_t       _spanShader;
+  Color4u            _color;
+  Vector2i           _p0;
+  Vector2i           _p1;
+  const Spritesheet* _sheet;
+  const SpriteMask*  _mask;
+  const TextRun*     _textRun;
+  int                _spriteid;
+  int                _arg;
+  int                _count;
+};
+
+//
+// A rectangle clamped to a screen; bounds are inclusive.
+//
+struct ClampedRect
+{
+  int _xmin;
+  int _ymin;
+  int _xmax;
+  int _ymax;
+};
+
+//
+// The commands recorded by a deferred screen since it was last presented; _rects and _points 
+// hold the rects and line end points of batched commands. The cached text runs drawn by text
+// commands are pinned in the cache until rasterised.
+//
+struct DrawList
+{
+  std::vector<DrawCommand> _commands;
+  std::vector<ClampedRect> _rects;
+  std::vector<Vector2i> _points;
+};
+
+static std::vector<DrawList> drawLists;     // indexed by screen id.
+
+//
+// A band of rows [_ymin, _ymax] of a screen to be rasterised by a single thread. Also used to
+// share the rows of the composite between threads, in which case _screenid is unused.
+//
+struct RasterTile
+{
+  int _screenid;
+  int _ymin;
+  int _ymax;
+};
+
+using RasterTileJob_t = void (*)(const RasterTile& tile);
+
+static constexpr int MAX_RASTER_THREADS = 64;
+static constexpr int MIN_RASTER_TILE_HEIGHT = 8;
+static constexpr int RASTER_TILES_PER_THREAD = 4;
+
+static int rasterThreadCount {1};           // includes the main thread.
+static std::vector<RasterTile> pendingRasterTiles;
+
+//
+// Opengl functions beyond 1.1 are not exported by all platform libraries thus are loaded at
+// runtime. Only those needed by PresentMode::TEXTURE are loaded.
+//
+static PFNGLGENBUFFERSPROC    pglGenBuffers;
+static PFNGLDELETEBUFFERSPROC pglDeleteBuffers;
+static PFNGLBINDBUFFERPROC    pglBindBuffer;
+static PFNGLBUFFERDATAPROC    pglBufferData;
+static PFNGLMAPBUFFERPROC     pglMapBuffer;
+static PFNGLUNMAPBUFFERPROC   pglUnmapBuffer;
+
+static PFNGLCREATESHADERPROC       pglCreateShader;
+static PFNGLSHADERSOURCEPROC       pglShaderSource;
+static PFNGLCOMPILESHADERPROC      pglCompileShader;
+static PFNGLGETSHADERIVPROC        pglGetShaderiv;
+static PFNGLDELETESHADERPROC       pglDeleteShader;
+static PFNGLCREATEPROGRAMPROC      pglCreateProgram;
+static PFNGLATTACHSHADERPROC       pglAttachShader;
+static PFNGLLINKPROGRAMPROC        pglLinkProgram;
+static PFNGLGETPROGRAMIVPROC       pglGetProgramiv;
+static PFNGLDELETEPROGRAMPROC      pglDeleteProgram;
+static PFNGLUSEPROGRAMPROC         pglUseProgram;
+static PFNGLGETUNIFORMLOCATIONPROC pglGetUniformLocation;
+static PFNGLUNIFORM1IPROC          pglUniform1i;
+static PFNGLACTIVETEXTUREPROC      pglActiveTexture;
+
+static constexpr int PBO_COUNT = 2;
+
+//
+// In PresentMode::TEXTURE PALETTE8 screens are streamed into single channel textures of their
+// indices and drawn with a fragment shader which looks up each index in a PALETTE_SIZE x 1
+// texture of the screen's palette. Swapping a palette thus uploads only the palette.
+//
+static constexpr const char* PALETTE_FRAGMENT_SHADER {
+  "uniform sampler2D indices;\n"
+  "uniform sampler2D palette;\n"
+  "void main()\n"
+  "{\n"
+  "  float index = texture2D(indices, gl_TexCoord[0].st).r;\n"
+  "  gl_FragColor = texture2D(palette, vec2((index * 255.0 + 0.5) / 256.0, 0.5));\n"
+  "}\n"
+};
+
+static constexpr int PALETTE_INDICES_TEXTURE_UNIT = 0;
+static constexpr int PALETTE_COLORS_TEXTURE_UNIT = 1;
+
+static unsigned paletteProgram;
+
+//
+// The colors of a PALETTE8 screen looked up in its palette when presented as points or
+// checksummed (which touch every pixel anyway); sized for the largest palette screen.
+//
+static std::vector<Color4u> resolvedColors;
+
+//
+// The layout of a screen within the composite; the composite is rebuilt if the layout of any
+// screen changes.
+//
+struct CompositeLayer
+{
+  bool _isEnabled;
+  Vector2i _position;
+  int _pxSize;
+};
+
+//
+// PresentMode::COMPOSITE state. The composite is a window sized buffer accessed 
+// [col + (row * compositeSize._x)].
+//
+static std::vector<Color4u> compositeColors;
+static Vector2i compositeSize;
+static std::vector<CompositeLayer> compositeLayers;
+static bool isCompositeStale {true};
+static unsigned compositeTexture;
+static unsigned compositePbos[PBO_COUNT];
+static int compositePboIndex;
+
+//
+// Points are not drawn in headless mode so the pixel size range is not limited by opengl;
+// the range chosen is arbitrary.
+//
+static constexpr int HEADLESS_MAX_PIXEL_SIZE = 64;
+
+static constexpr uint64_t FNV_OFFSET_BASIS = 14695981039346656037ull;
+static constexpr uint64_t FNV_PRIME = 1099511628211ull;
+
+static constexpr std::array<const char*, 3> blitKernelNames {"scalar", "sse2", "avx2"};
 
 struct SpritesheetResource
 {
@@ -58,6 +300,13 @@ struct SpritesheetResource
   int _referenceCount;
 };
 
+struct SpriteMaskResource
+{
+  SpriteMask _mask;
+  std::string _name;
+  int _referenceCount;
+};
+
 struct FontResource
 {
   Font _font;
@@ -65,15 +314,29 @@ struct FontResource
   int _referenceCount;
 };
 
-static ResourceKey_t nextResourceKey {0};
-
-static std::map<ResourceKey_t, SpritesheetResource> spritesheets;
-static std::map<ResourceKey_t, FontResource> fonts;
+//
+// Resources are looked up on every draw call so are held in handle tables; the resource keys
+// returned to clients are the handles. Inserting into a table may relocate its resources so
+// any pending deferred draws (which point into the tables) must be rasterised first.
+//
+static HandleTable<SpritesheetResource> spritesheets;
+static HandleTable<FontResource> fonts;
+static HandleTable<SpriteMaskResource> spriteMasks;
 
 static constexpr const char* errorSpritesheetName {"error_spritesheet"};
 static constexpr const char* errorFontName {"error_font"};
+static constexpr const char* errorPaletteSpritesheetName {"error_palette_spritesheet"};
+static constexpr const char* errorPaletteFontName {"error_palette_font"};
+static constexpr const char* errorSpriteMaskName {"error_spritemask"};
+
+//
+// The palette index of the error spritesheet and font substituted for palette resources.
+//
+static constexpr PaletteIndex_t errorPaletteIndex {PALETTE_SIZE - 1};
 
 static ResourceKey_t errorSpritesheetKey;
+static ResourceKey_t errorPaletteSpritesheetKey;
+static ResourceKey_t errorSpriteMaskKey;
 static SpritesheetResource errorSpritesheet;
 static FontResource errorFont;
 
@@ -88,6 +351,45 @@ static Color4u pxShaderDefault(Color4u color, int pxx, int pxy)
   return color;
 }
 
+//
+// Grows the dirty region of a screen to include the region [xmin, xmax] x [ymin, ymax]. The
+// region is clamped to the screen thus callers may pass unclipped bounds.
+//
+static void markDirty(Screen& screen, int xmin, int ymin, int xmax, int ymax)
+{
+  xmin = std::max(xmin, 0);
+  ymin = std::max(ymin, 0);
+  xmax = std::min(xmax, screen._resolution._x - 1);
+  ymax = std::min(ymax, screen._resolution._y - 1);
+  if(xmin > xmax || ymin > ymax)
+    return;
+
+  if(!screen._isDirty){
+    screen._dirtyMin = Vector2i{xmin, ymin};
+    screen._dirtyMax = Vector2i{xmax, ymax};
+    screen._isDirty = true;
+    return;
+  }
+
+  screen._dirtyMin._x = std::min(screen._dirtyMin._x, xmin);
+  screen._dirtyMin._y = std::min(screen._dirtyMin._y, ymin);
+  screen._dirtyMax._x = std::max(screen._dirtyMax._x, xmax);
+  screen._dirtyMax._y = std::max(screen._dirtyMax._y, ymax);
+}
+
+static void markAllDirty(Screen& screen)
+{
+  markDirty(screen, 0, 0, screen._resolution._x - 1, screen._resolution._y - 1);
+}
+
+static int getDirtyPixelCount(const Screen& screen)
+{
+  if(!screen._isDirty)
+    return 0;
+  return (screen._dirtyMax._x - screen._dirtyMin._x + 1) * 
+         (screen._dirtyMax._y - screen._dirtyMin._y + 1);
+}
+
 static void setViewport(iRect viewport)
 {
   glMatrixMode(GL_PROJECTION);
@@ -99,13 +401,264 @@ static void setViewport(iRect viewport)
   pxr::gfx::viewport = viewport;
 }
 
+//
+// Extracts the major and minor version from an opengl version string, which begins
+// "<major>.<minor>". Returns false if the string is malformed.
+//
+static bool parseGLVersion(const char* glVersion, int& major, int& minor)
+{
+  return glVersion != nullptr && std::sscanf(glVersion, "%d.%d", &major, &minor) == 2;
+}
+
+static bool isGLVersionAtLeast(int major, int minor, int requiredMajor, int requiredMinor)
+{
+  return major > requiredMajor || (major == requiredMajor && minor >= requiredMinor);
+}
+
+//
+// Loads the opengl functions required by PresentMode::TEXTURE. Returns false if the context
+// does not support pixel buffer objects (opengl 2.1 or GL_ARB_pixel_buffer_object) or any 
+// function is unavailable, in which case the texture present mode cannot be used.
+//
+// The context must be checked first as some platforms (e.g. glx) return non-null addresses 
+// for any function name whether or not the context supports it.
+//
+static bool loadTextureProcs(int glMajor, int glMinor)
+{
+  bool hasPbos = isGLVersionAtLeast(glMajor, glMinor, MIN_OPENGL_VERSION_MAJOR, MIN_OPENGL_VERSION_MINOR) ||
+                 SDL_GL_ExtensionSupported("GL_ARB_pixel_buffer_object");
+  if(!hasPbos)
+    return false;
+
+  pglGenBuffers = reinterpret_cast<PFNGLGENBUFFERSPROC>(SDL_GL_GetProcAddress("glGenBuffers"));
+  pglDeleteBuffers = reinterpret_cast<PFNGLDELETEBUFFERSPROC>(SDL_GL_GetProcAddress("glDeleteBuffers"));
+  pglBindBuffer = reinterpret_cast<PFNGLBINDBUFFERPROC>(SDL_GL_GetProcAddress("glBindBuffer"));
+  pglBufferData = reinterpret_cast<PFNGLBUFFERDATAPROC>(SDL_GL_GetProcAddress("glBufferData"));
+  pglMapBuffer = reinterpret_cast<PFNGLMAPBUFFERPROC>(SDL_GL_GetProcAddress("glMapBuffer"));
+  pglUnmapBuffer = reinterpret_cast<PFNGLUNMAPBUFFERPROC>(SDL_GL_GetProcAddress("glUnmapBuffer"));
+
+  return pglGenBuffers && pglDeleteBuffers && pglBindBuffer &&
+         pglBufferData && pglMapBuffer && pglUnmapBuffer;
+}
+
+//
+// Loads the opengl functions required to draw PALETTE8 screens in PresentMode::TEXTURE. 
+// Returns false if the context does not support glsl (opengl 2.0) or any function is 
+// unavailable.
+//
+static bool loadPaletteProcs(int glMajor, int glMinor)
+{
+  if(!isGLVersionAtLeast(glMajor, glMinor, MIN_GLSL_OPENGL_VERSION_MAJOR, MIN_GLSL_OPENGL_VERSION_MINOR))
+    return false;
+
+  pglCreateShader = reinterpret_cast<PFNGLCREATESHADERPROC>(SDL_GL_GetProcAddress("glCreateShader"));
+  pglShaderSource = reinterpret_cast<PFNGLSHADERSOURCEPROC>(SDL_GL_GetProcAddress("glShaderSource"));
+  pglCompileShader = reinterpret_cast<PFNGLCOMPILESHADERPROC>(SDL_GL_GetProcAddress("glCompileShader"));
+  pglGetShaderiv = reinterpret_cast<PFNGLGETSHADERIVPROC>(SDL_GL_GetProcAddress("glGetShaderiv"));
+  pglDeleteShader = reinterpret_cast<PFNGLDELETESHADERPROC>(SDL_GL_GetProcAddress("glDeleteShader"));
+  pglCreateProgram = reinterpret_cast<PFNGLCREATEPROGRAMPROC>(SDL_GL_GetProcAddress("glCreateProgram"));
+  pglAttachShader = reinterpret_cast<PFNGLATTACHSHADERPROC>(SDL_GL_GetProcAddress("glAttachShader"));
+  pglLinkProgram = reinterpret_cast<PFNGLLINKPROGRAMPROC>(SDL_GL_GetProcAddress("glLinkProgram"));
+  pglGetProgramiv = reinterpret_cast<PFNGLGETPROGRAMIVPROC>(SDL_GL_GetProcAddress("glGetProgramiv"));
+  pglDeleteProgram = reinterpret_cast<PFNGLDELETEPROGRAMPROC>(SDL_GL_GetProcAddress("glDeleteProgram"));
+  pglUseProgram = reinterpret_cast<PFNGLUSEPROGRAMPROC>(SDL_GL_GetProcAddress("glUseProgram"));
+  pglGetUniformLocation = reinterpret_cast<PFNGLGETUNIFORMLOCATIONPROC>(SDL_GL_GetProcAddress("glGetUniformLocation"));
+  pglUniform1i = reinterpret_cast<PFNGLUNIFORM1IPROC>(SDL_GL_GetProcAddress("glUniform1i"));
+  pglActiveTexture = reinterpret_cast<PFNGLACTIVETEXTUREPROC>(SDL_GL_GetProcAddress("glActiveTexture"));
+
+  return pglCreateShader && pglShaderSource && pglCompileShader && pglGetShaderiv && 
+         pglDeleteShader && pglCreateProgram && pglAttachShader && pglLinkProgram && 
+         pglGetProgramiv && pglDeleteProgram && pglUseProgram && pglGetUniformLocation && 
+         pglUniform1i && pglActiveTexture;
+}
+
+//
+// Compiles and links the palette lookup program (see PALETTE_FRAGMENT_SHADER). Only a fragment
+// shader is supplied; vertices are still processed by the fixed function pipeline. Returns 
+// false if the program failed to build.
+//
+static bool createPaletteProgram()
+{
+  const GLchar* source {PALETTE_FRAGMENT_SHADER};
+  GLuint shader = pglCreateShader(GL_FRAGMENT_SHADER);
+  pglShaderSource(shader, 1, &source, nullptr);
+  pglCompileShader(shader);
+
+  GLint isCompiled {GL_FALSE};
+  pglGetShaderiv(shader, GL_COMPILE_STATUS, &isCompiled);
+  if(isCompiled != GL_TRUE){
+    pglDeleteShader(shader);
+    return false;
+  }
+
+  paletteProgram = pglCreateProgram();
+  pglAttachShader(paletteProgram, shader);
+  pglLinkProgram(paletteProgram);
+  pglDeleteShader(shader);     // only flagged for deletion whilst attached to the program.
+
+  GLint isLinked {GL_FALSE};
+  pglGetProgramiv(paletteProgram, GL_LINK_STATUS, &isLinked);
+  if(isLinked != GL_TRUE){
+    pglDeleteProgram(paletteProgram);
+    paletteProgram = 0;
+    return false;
+  }
+
+  pglUseProgram(paletteProgram);
+  pglUniform1i(pglGetUniformLocation(paletteProgram, "indices"), PALETTE_INDICES_TEXTURE_UNIT);
+  pglUniform1i(pglGetUniformLocation(paletteProgram, "palette"), PALETTE_COLORS_TEXTURE_UNIT);
+  pglUseProgram(0);
+  return true;
+}
+
+//
+// Creates a nearest filtered, edge clamped texture initialised with 'pixels'.
+//
+static unsigned createNearestTexture(GLint internalFormat, int w, int h, GLenum format, const void* pixels)
+{
+  unsigned texture;
+  glGenTextures(1, &texture);
+  glBindTexture(GL_TEXTURE_2D, texture);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, w, h, 0, format, GL_UNSIGNED_BYTE, pixels);
+  return texture;
+}
+
+//
+// Appends the opaque runs of a row of 'w' src pixels to 'runs' and their pixels to 'runPixels'.
+// Returns the range of runs appended.
+//
+static SpriteRunRow appendRowRuns(const Color4u* src, int w, std::vector<SpriteRun>& runs, 
+                                  std::vector<Color4u>& runPixels)
+{
+  SpriteRunRow runRow;
+  runRow._begin = runs.size();
+  for(int col = 0; col < w;){
+    if(src[col]._a == ALPHA_KEY){
+      ++col;
+      continue;
+    }
+    SpriteRun run{col, 0, static_cast<int>(runPixels.size())};
+    for(; col < w && src[col]._a != ALPHA_KEY; ++col, ++run._length)
+      runPixels.push_back(src[col]);
+    runs.push_back(run);
+  }
+  runRow._end = runs.size();
+  return runRow;
+}
+
+//
+// The palette of default colors, i.e. index i is paletteColor(i).
+//
+static Palette_t defaultPalette()
+{
+  Palette_t palette;
+  for(int index = 0; index < PALETTE_SIZE; ++index)
+    palette[index] = paletteColor(index);
+  return palette;
+}
+
+//
+// Internally palette indices are carried through the draw calls and the pixels of palette
+// resources as their default colors (see paletteColor), which this inverts. Only the colors
+// of palette draws and resources are converted, so every color converted is a default color.
+//
+static inline PaletteIndex_t toPaletteIndex(Color4u color)
+{
+  return color._a == ALPHA_KEY ? PALETTE_KEY : color._r;
+}
+
+//
+// Converts the run pixels of a palette resource to palette indices.
+//
+static void indexRunPixels(const std::vector<Color4u>& runPixels, std::vector<PaletteIndex_t>& runIndices)
+{
+  runIndices.resize(runPixels.size());
+  std::transform(runPixels.begin(), runPixels.end(), runIndices.begin(), toPaletteIndex);
+}
+
+//
+// PALETTE8 screens only accept palette index draws and palette resources (see ColorMode); any 
+// other draw is a misuse which asserts, and is dropped in release builds.
+//
+static bool isDrawableOn(const Screen& screen, bool isPalette)
+{
+  bool isDrawable = screen._cmode != ColorMode::PALETTE8 || isPalette;
+  assert(isDrawable);
+  return isDrawable;
+}
+
+//
+// Compiles the opaque pixels of all sprites of a sheet into runs; see Spritesheet. Only the
+// unmirrored and x-mirrored runs are baked; the y-mirrored variants reference the same runs in 
+// reverse row order.
+//
+static void bakeSpriteRuns(Spritesheet& sheet)
+{
+  const Color4u* const* sheetPxs = sheet._image.getPixels();
+
+  sheet._spriteRunRows.clear();
+  sheet._runRows.clear();
+  sheet._runs.clear();
+  sheet._runPixels.clear();
+
+  for(const auto& sprite : sheet._sprites){
+    int w = sprite._size._x;
+    int h = sprite._size._y;
+    int base = sheet._runRows.size();
+    sheet._spriteRunRows.push_back(base + (MIRROR_NONE * h));
+    sheet._spriteRunRows.push_back(base + (MIRROR_X * h));
+    sheet._spriteRunRows.push_back(base + (MIRROR_Y * h));
+    sheet._spriteRunRows.push_back(base + (MIRROR_XY * h));
+    sheet._runRows.resize(base + (MIRROR_COUNT * h));
+
+    for(int row = 0; row < h; ++row){
+      const Color4u* src = sheetPxs[sprite._position._y + row] + sprite._position._x;
+      sheet._runRows[base + (MIRROR_NONE * h) + row] = appendRowRuns(src, w, sheet._runs, sheet._runPixels);
+    }
+
+    for(int row = 0; row < h; ++row){
+      const SpriteRunRow unmirrored = sheet._runRows[base + (MIRROR_NONE * h) + row];
+      SpriteRunRow& runRow = sheet._runRows[base + (MIRROR_X * h) + row];
+      runRow._begin = sheet._runs.size();
+      for(int i = unmirrored._end - 1; i >= unmirrored._begin; --i){
+        SpriteRun run = sheet._runs[i];
+        int first = run._pixels;
+        run._col = w - run._col - run._length;
+        run._pixels = sheet._runPixels.size();
+        for(int px = first + run._length - 1; px >= first; --px){
+          Color4u color = sheet._runPixels[px];
+          sheet._runPixels.push_back(color);
+        }
+        sheet._runs.push_back(run);
+      }
+      runRow._end = sheet._runs.size();
+    }
+
+    for(int row = 0; row < h; ++row){
+      sheet._runRows[base + (MIRROR_Y * h) + row] = sheet._runRows[base + (MIRROR_NONE * h) + (h - 1 - row)];
+      sheet._runRows[base + (MIRROR_XY * h) + row] = sheet._runRows[base + (MIRROR_X * h) + (h - 1 - row)];
+    }
+  }
+
+  sheet._runIndices.clear();
+  if(sheet._isPalette)
+    indexRunPixels(sheet._runPixels, sheet._runIndices);
+}
+
 // 
-// Generates a red sqaure spritesheet with the (single) sprite's origin in the bottom-left.
+// Generates a red sqaure spritesheet with the (single) sprite's origin in the bottom-left. The
+// palette variant is a square of errorPaletteIndex.
 //
-static void genErrorSpritesheet()
+static ResourceKey_t genErrorSpritesheet(ColorMode colorMode)
 {
   static constexpr int squareSize = 8;
 
+  bool isPalette = colorMode == ColorMode::PALETTE8;
+
   SpritesheetResource resource {};
 
   Sprite sprite{};
@@ -113,29 +666,49 @@ static void genErrorSpritesheet()
   sprite._size = Vector2i{squareSize, squareSize};
   sprite._origin = Vector2i{0, 0};
 
-  resource._sheet._image.create(sprite._size, colors::red);
+  resource._sheet._image.create(sprite._size, isPalette ? paletteColor(errorPaletteIndex) : colors::red);
   resource._sheet._sprites.push_back(sprite);
+  resource._sheet._isPalette = isPalette;
+  bakeSpriteRuns(resource._sheet);
 
-  resource._name = errorSpritesheetName;
+  resource._name = isPalette ? errorPaletteSpritesheetName : errorSpritesheetName;
   resource._referenceCount = 0;
 
-  errorSpritesheetKey = nextResourceKey++;
+  return spritesheets.insert(std::move(resource));
+}
+
+//
+// Generates a fully set 8x8 square sprite mask.
+//
+static void genErrorSpriteMask()
+{
+  static constexpr int squareSize = 8;
+
+  SpriteMaskResource resource {};
+  resource._mask._size = Vector2i{squareSize, squareSize};
+  resource._mask._wordsPerRow = 1;
+  resource._mask._words.assign(squareSize, (1ull << squareSize) - 1);
+  resource._name = errorSpriteMaskName;
+  resource._referenceCount = 0;
 
-  spritesheets.emplace(std::make_pair(errorSpritesheetKey, resource));
+  errorSpriteMaskKey = spriteMasks.insert(std::move(resource));
 }
 
 //
 // Generates an 8px font with all 95 printable ascii characters where all characters are just 
-// blank red squares.
+// blank red squares. The palette variant's squares are of errorPaletteIndex.
 //
-static void genErrorFont()
+static void genErrorFont(ColorMode colorMode)
 {
+  bool isPalette = colorMode == ColorMode::PALETTE8;
+
   FontResource resource {};
 
   resource._font._lineHeight = 8;
   resource._font._baseLine = 1;
   resource._font._glyphSpace = 0;
-  resource._font._image.create(Vector2i{8, 8}, colors::red);
+  resource._font._image.create(Vector2i{8, 8}, isPalette ? paletteColor(errorPaletteIndex) : colors::red);
+  resource._font._isPalette = isPalette;
   for(auto& glyph : resource._font._glyphs){
     glyph._x = 0;
     glyph._y = 0;
@@ -146,20 +719,17 @@ static void genErrorFont()
     glyph._xadvance = 8;
   }
 
-  resource._name = errorFontName;
+  resource._name = isPalette ? errorPaletteFontName : errorFontName;
   resource._referenceCount = 0;
 
-  fonts.emplace(std::make_pair(nextResourceKey++, resource));
+  fonts.insert(std::move(resource));
 }
 
-bool initialize(std::string windowTitle_, Vector2i windowSize_, bool fullscreen_)
+//
+// Creates the window and opengl context and sets the opengl state used by the present mode.
+//
+static bool initializeOpenGL()
 {
-  log::log(log::INFO, log::msg_gfx_initializing);
-
-  windowSize = windowSize_;
-  windowTitle = windowTitle_;
-  fullscreen = fullscreen_;
-
   uint32_t flags = SDL_WINDOW_OPENGL;
   if(fullscreen){
     flags |= SDL_WINDOW_FULLSCREEN_DESKTOP;
@@ -205,10 +775,17 @@ bool initialize(std::string windowTitle_, Vector2i windowSize_, bool fullscreen_
     return false;
   }
 
-  std::string glVersion {reinterpret_cast<const char*>(glGetString(GL_VERSION))};
-  log::log(log::INFO, log::msg_gfx_opengl_version, glVersion);
+  const char* glVersion {reinterpret_cast<const char*>(glGetString(GL_VERSION))};
+  log::log(log::INFO, log::msg_gfx_opengl_version, glVersion != nullptr ? glVersion : "");
 
-  // TODO: extract version from string and check it meets min requirement.
+  int glMajor {0}, glMinor {0};
+  if(!parseGLVersion(glVersion, glMajor, glMinor))
+    log::log(log::WARN, log::msg_gfx_fail_parse_opengl_version);
+  else if(!isGLVersionAtLeast(glMajor, glMinor, MIN_OPENGL_VERSION_MAJOR, MIN_OPENGL_VERSION_MINOR)){
+    std::stringstream().swap(ss);
+    ss << "[min:" << MIN_OPENGL_VERSION_MAJOR << "." << MIN_OPENGL_VERSION_MINOR << "]";
+    log::log(log::WARN, log::msg_gfx_opengl_version_below_min, std::string{ss.str()});
+  }
 
   const char* glRenderer = reinterpret_cast<const char*>(glGetString(GL_RENDERER));
   log::log(log::INFO, log::msg_gfx_opengl_renderer, glRenderer);
@@ -226,32 +803,161 @@ bool initialize(std::string windowTitle_, Vector2i windowSize_, bool fullscreen_
 
   setViewport(iRect{0, 0, windowSize._x, windowSize._y});
 
-  glEnableClientState(GL_VERTEX_ARRAY);
-  glEnableClientState(GL_COLOR_ARRAY);
+  bool isTextured = presentMode == PresentMode::TEXTURE || presentMode == PresentMode::COMPOSITE;
+  if(isTextured && !loadTextureProcs(glMajor, glMinor)){
+    log::log(log::WARN, log::msg_gfx_fail_load_texture_procs);
+    presentMode = PresentMode::POINTS;
+    isTextured = false;
+  }
+
+  if(presentMode == PresentMode::TEXTURE && !(loadPaletteProcs(glMajor, glMinor) && createPaletteProgram())){
+    log::log(log::WARN, log::msg_gfx_fail_create_palette_program);
+    presentMode = PresentMode::POINTS;
+    isTextured = false;
+  }
+
+  if(isTextured){
+    log::log(log::INFO, log::msg_gfx_present_mode, presentMode == PresentMode::TEXTURE ? "texture" : "composite");
+    glEnable(GL_TEXTURE_2D);
+    glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);    // rows of palette indices may be any length.
+  }
+  else{
+    log::log(log::INFO, log::msg_gfx_present_mode, "points");
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_COLOR_ARRAY);
+  }
+
   glEnable(GL_ALPHA_TEST);
   glAlphaFunc(GL_GREATER, 0.f);
 
-  genErrorSpritesheet();
-  genErrorFont();
+  return true;
+}
+
+//
+// Creates the window sized composite buffer and, if presenting with opengl, the texture and
+// pixel buffer objects it is streamed through.
+//
+static void createComposite()
+{
+  compositeSize = windowSize;
+  compositeColors.assign(compositeSize._x * compositeSize._y, Color4u{});
+  isCompositeStale = true;
+
+  if(backend != Backend::OPENGL)
+    return;
+
+  compositeTexture = createNearestTexture(GL_RGBA8, compositeSize._x, compositeSize._y, GL_RGBA, compositeColors.data());
+
+  int bytes = compositeColors.size() * sizeof(Color4u);
+  pglGenBuffers(PBO_COUNT, compositePbos);
+  for(int i = 0; i < PBO_COUNT; ++i){
+    pglBindBuffer(GL_PIXEL_UNPACK_BUFFER, compositePbos[i]);
+    pglBufferData(GL_PIXEL_UNPACK_BUFFER, bytes, nullptr, GL_STREAM_DRAW);
+  }
+  pglBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  compositePboIndex = 0;
+}
+
+static void freeComposite()
+{
+  if(presentMode != PresentMode::COMPOSITE)
+    return;
+  compositeColors.clear();
+  if(backend == Backend::OPENGL){
+    glDeleteTextures(1, &compositeTexture);
+    pglDeleteBuffers(PBO_COUNT, compositePbos);
+  }
+}
+
+static void reserveTextRuns();
+
+bool initialize(std::string windowTitle_, Vector2i windowSize_, bool fullscreen_,
+                PresentMode presentMode_, Backend backend_)
+{
+  log::log(log::INFO, log::msg_gfx_initializing);
+
+  windowSize = windowSize_;
+  windowTitle = windowTitle_;
+  fullscreen = fullscreen_;
+  presentMode = presentMode_;
+  backend = backend_;
+
+  if(backend == Backend::HEADLESS){
+    log::log(log::INFO, log::msg_gfx_backend, "headless");
+    minPixelSize = 1;
+    maxPixelSize = HEADLESS_MAX_PIXEL_SIZE;
+    viewport = iRect{0, 0, windowSize._x, windowSize._y};
+    if(presentMode != PresentMode::COMPOSITE)
+      presentMode = PresentMode::POINTS;
+  }
+  else{
+    log::log(log::INFO, log::msg_gfx_backend, "opengl");
+    if(!initializeOpenGL())
+      return false;
+  }
+
+
+  if(presentMode == PresentMode::COMPOSITE)
+    createComposite();
+
+  initializeBlit();
+  log::log(log::INFO, log::msg_gfx_blit_kernel, blitKernelNames[static_cast<int>(getBlitKernel())]);
+
+  errorSpritesheetKey = genErrorSpritesheet(ColorMode::FULL_RGB);
+  errorPaletteSpritesheetKey = genErrorSpritesheet(ColorMode::PALETTE8);
+  genErrorFont(ColorMode::FULL_RGB);
+  genErrorFont(ColorMode::PALETTE8);
+  genErrorSpriteMask();
+
+  reserveTextRuns();
 
   return true;
 }
 
+PresentMode getPresentMode()
+{
+  return presentMode;
+}
+
+Backend getBackend()
+{
+  return backend;
+}
+
+static void rasterDeferredDraws();
+static void evictTextRuns(ResourceKey_t fontKey);
+
+
 static void freeScreens()
 {
+  drawLists.clear();
   for(auto& screen : screens){
     delete[] screen._pxColors;
+    delete[] screen._pxIndices;
     delete[] screen._pxPositions;
     screen._pxColors = nullptr;
+    screen._pxIndices = nullptr;
     screen._pxPositions = nullptr;
+    if(presentMode == PresentMode::TEXTURE){
+      glDeleteTextures(1, &screen._glTexture);
+      pglDeleteBuffers(PBO_COUNT, screen._glPbos);
+      if(screen._cmode == ColorMode::PALETTE8)
+        glDeleteTextures(1, &screen._glPaletteTexture);
+    }
   }
 }
 
 void shutdown()
 {
   freeScreens();
-  SDL_GL_DeleteContext(glContext);
-  SDL_DestroyWindow(window);
+  freeComposite();
+  if(presentMode == PresentMode::TEXTURE && backend == Backend::OPENGL)
+    pglDeleteProgram(paletteProgram);
+  if(backend == Backend::OPENGL){
+    SDL_GL_DeleteContext(glContext);
+    SDL_DestroyWindow(window);
+  }
 }
 
 //
@@ -315,7 +1021,39 @@ static void autoAdjustScreen(Vector2i windowSize, Screen& screen)
   }
 }
 
-int createScreen(Vector2i resolution)
+//
+// Creates the texture and pixel buffer objects a screen is streamed through in
+// PresentMode::TEXTURE. The texture matches the screen resolution exactly (opengl 2.0+
+// supports non-power-of-two textures) and is scaled to the window by the quad it is drawn on.
+// PALETTE8 screens stream their indices into a single channel texture and also have a 
+// texture of their palette.
+//
+static void createScreenTexture(Screen& screen)
+{
+  int w = screen._resolution._x;
+  int h = screen._resolution._y;
+  int bytes {0};
+  if(screen._cmode == ColorMode::PALETTE8){
+    screen._glTexture = createNearestTexture(GL_LUMINANCE8, w, h, GL_LUMINANCE, screen._pxIndices);
+    screen._glPaletteTexture = createNearestTexture(GL_RGBA8, PALETTE_SIZE, 1, GL_RGBA, screen._palette.data());
+    screen._isPaletteStale = false;
+    bytes = screen._pxCount * sizeof(PaletteIndex_t);
+  }
+  else{
+    screen._glTexture = createNearestTexture(GL_RGBA8, w, h, GL_RGBA, screen._pxColors);
+    bytes = screen._pxCount * sizeof(Color4u);
+  }
+
+  pglGenBuffers(PBO_COUNT, screen._glPbos);
+  for(int i = 0; i < PBO_COUNT; ++i){
+    pglBindBuffer(GL_PIXEL_UNPACK_BUFFER, screen._glPbos[i]);
+    pglBufferData(GL_PIXEL_UNPACK_BUFFER, bytes, nullptr, GL_STREAM_DRAW);
+  }
+  pglBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  screen._pboIndex = 0;
+}
+
+int createScreen(Vector2i resolution, ColorMode colorMode)
 {
   assert(resolution._x > 0 && resolution._y > 0);
 
@@ -325,22 +1063,43 @@ int createScreen(Vector2i resolution)
   auto& screen = screens.back();
 
   screen._pxShader = pxShaderDefault;
+  screen._spanShader = nullptr;
   screen._pmode = PositionMode::CENTER;
   screen._smode = SizeMode::AUTO_MAX;
   screen._xmode = PixelMode::NO_SHADER;
+  screen._dmode = DrawMode::IMMEDIATE;
+  screen._cmode = colorMode;
   screen._position = Vector2i{0, 0};
   screen._manualPosition = Vector2i{0, 0};
   screen._resolution = resolution;
   screen._pxManualSize = 1;
   screen._pxCount = screen._resolution._x * screen._resolution._y;
-  screen._pxColors = new Color4u[screen._pxCount];
+  screen._pxColors = nullptr;
+  screen._pxIndices = nullptr;
   screen._pxPositions = new Vector2i[screen._pxCount];
+  if(colorMode == ColorMode::PALETTE8){
+    screen._pxIndices = new PaletteIndex_t[screen._pxCount];
+    screen._palette = defaultPalette();
+    screen._isPaletteStale = false;
+    if(presentMode == PresentMode::POINTS && resolvedColors.size() < screen._pxCount)
+      resolvedColors.resize(screen._pxCount);
+  }
+  else
+    screen._pxColors = new Color4u[screen._pxCount];
+  screen._isDirty = false;
   screen._isEnabled = true;
 
-  clearScreenTransparent(screenid); 
+  drawLists.emplace_back();
+
+  clearScreenTransparent(screenid);
   autoAdjustScreen(windowSize, screen);
 
-  int memkib = ((screen._pxCount * sizeof(Color4u)) + (screen._pxCount * sizeof(Vector2i))) / 1024;
+  if(presentMode == PresentMode::TEXTURE)
+    createScreenTexture(screen);
+
+  int pxBytes = sizeof(Vector2i);
+  pxBytes += (colorMode == ColorMode::PALETTE8) ? sizeof(PaletteIndex_t) : sizeof(Color4u);
+  int memkib = (screen._pxCount * pxBytes) / 1024;
 
   std::stringstream ss {};
   ss << "resolution:" << resolution._x << "x" << resolution._y << "vpx mem:" << memkib << "kib";
@@ -349,46 +1108,72 @@ int createScreen(Vector2i resolution)
   return screenid;
 }
 
-static ResourceKey_t useErrorSpritesheet()
-{
-  for(auto& pair : spritesheets){
-    if(pair.second._name == errorSpritesheetName){
-      pair.second._referenceCount++;
-      std::string addendum = "ref count=" + std::to_string(pair.second._referenceCount);
-      log::log(log::INFO, log::msg_gfx_using_error_spritesheet, addendum);
-      return pair.first;
-    }
+//
+// Prepares the bmp of a resource loaded for PALETTE8 screens. The bmp must be indexed, in 
+// which case each pixel is recolored to the default color of its index (see toPaletteIndex).
+// Returns false, logging the rejection, if the bmp is not indexed.
+//
+static bool indexPaletteImage(io::Bmp& image, ResourceName_t name)
+{
+  if(!image.isIndexed()){
+    log::log(log::ERROR, log::msg_gfx_palette_asset_not_indexed, name);
+    return false;
   }
-  
-  assert(0);   // This would mean the error sprite has not been generated.
+
+  static const Palette_t palette = defaultPalette();
+  image.mapIndices(palette.data());
+  return true;
 }
 
-static ResourceKey_t useErrorFont()
+static ResourceKey_t useErrorSpritesheet(ColorMode colorMode)
 {
-  for(auto& resource : fonts){
-    if(resource.second._name == errorFontName){
-      resource.second._referenceCount++;
-      std::string addendum = "ref count=" + std::to_string(resource.second._referenceCount);
-      log::log(log::INFO, log::msg_gfx_using_error_font, addendum);
-      return resource.first;
-    }
-  }
+  ResourceKey_t errorKey = (colorMode == ColorMode::PALETTE8) ? errorPaletteSpritesheetKey : errorSpritesheetKey;
+  assert(spritesheets.isValid(errorKey)); // else the error sprite has not been generated.
+
+  SpritesheetResource& resource = spritesheets[errorKey];
+  resource._referenceCount++;
+  std::string addendum = "ref count=" + std::to_string(resource._referenceCount);
+  log::log(log::INFO, log::msg_gfx_using_error_spritesheet, addendum);
+  return errorKey;
+}
+
+static ResourceKey_t useErrorFont(ColorMode colorMode)
+{
+  const char* errorName = (colorMode == ColorMode::PALETTE8) ? errorPaletteFontName : errorFontName;
+  ResourceKey_t errorFontKey {fonts.NULL_HANDLE};
+  fonts.forEach([&errorFontKey, errorName](ResourceKey_t fontKey, FontResource& resource){
+    if(resource._name == errorName)
+      errorFontKey = fontKey;
+  });
+
+  assert(errorFontKey != fonts.NULL_HANDLE);  // This would mean the error font has not been generated.
 
-  assert(0);  // This would mean the error font has not been generated.
+  FontResource& resource = fonts[errorFontKey];
+  resource._referenceCount++;
+  std::string addendum = "ref count=" + std::to_string(resource._referenceCount);
+  log::log(log::INFO, log::msg_gfx_using_error_font, addendum);
+  return errorFontKey;
 }
 
-ResourceKey_t loadSpritesheet(ResourceName_t name)
+ResourceKey_t loadSpritesheet(ResourceName_t name, ColorMode colorMode)
 {
   log::log(log::INFO, log::msg_gfx_loading_spritesheet, name);
 
-  for(auto& pair : spritesheets){
-    if(pair.second._name == name){
-      pair.second._referenceCount++;
-      std::string addendum {"ref count="};
-      addendum += std::to_string(pair.second._referenceCount);
-      log::log(log::INFO, log::msg_gfx_spritesheet_already_loaded, addendum);
-      return pair.first;
-    }
+  bool isPalette = colorMode == ColorMode::PALETTE8;
+
+  ResourceKey_t loadedKey {spritesheets.NULL_HANDLE};
+  spritesheets.forEach([&loadedKey, name, isPalette](ResourceKey_t sheetKey, SpritesheetResource& resource){
+    if(resource._name == name && resource._sheet._isPalette == isPalette)
+      loadedKey = sheetKey;
+  });
+
+  if(loadedKey != spritesheets.NULL_HANDLE){
+    SpritesheetResource& resource = spritesheets[loadedKey];
+    resource._referenceCount++;
+    std::string addendum {"ref count="};
+    addendum += std::to_string(resource._referenceCount);
+    log::log(log::INFO, log::msg_gfx_spritesheet_already_loaded, addendum);
+    return loadedKey;
   }
 
   SpritesheetResource resource{};
@@ -403,23 +1188,27 @@ ResourceKey_t loadSpritesheet(ResourceName_t name)
   bmppath += Bmp::FILE_EXTENSION;
   if(!sheet._image.load(bmppath)){
     log::log(log::ERROR, log::msg_gfx_fail_load_asset_bmp, name);
-    return useErrorSpritesheet();
+    return useErrorSpritesheet(colorMode);
   }
 
+  if(isPalette && !indexPaletteImage(sheet._image, name))
+    return useErrorSpritesheet(colorMode);
+  sheet._isPalette = isPalette;
+
   std::string xmlpath {};
   xmlpath += RESOURCE_PATH_SPRITESHEETS;
   xmlpath += name;
   xmlpath += XML_RESOURCE_EXTENSION_SPRITESHEETS;
   XMLDocument doc{};
   if(!parseXmlDocument(&doc, xmlpath)) 
-    return useErrorSpritesheet();
+    return useErrorSpritesheet(colorMode);
 
   XMLElement* xmlsheet{nullptr};
   XMLElement* xmlsprite{nullptr};
 
   int err{0};
-  if(!extractChildElement(&doc, &xmlsheet, "spritesheet")) return useErrorSpritesheet();
-  if(!extractChildElement(xmlsheet, &xmlsprite, "sprite")) return useErrorSpritesheet();
+  if(!extractChildElement(&doc, &xmlsheet, "spritesheet")) return useErrorSpritesheet(colorMode);
+  if(!extractChildElement(xmlsheet, &xmlsprite, "sprite")) return useErrorSpritesheet(colorMode);
   do{
     Sprite sprite{};
     if(!extractIntAttribute(xmlsprite, "x", &sprite._position._x)){++err; break;}
@@ -432,7 +1221,7 @@ ResourceKey_t loadSpritesheet(ResourceName_t name)
     xmlsprite = xmlsprite->NextSiblingElement("sprite");
   }
   while(xmlsprite != 0);
-  if(err) return useErrorSpritesheet();
+  if(err) return useErrorSpritesheet(colorMode);
 
   // 
   // Validate all sprites to avoid segfaults.
@@ -450,13 +1239,13 @@ ResourceKey_t loadSpritesheet(ResourceName_t name)
 
   if(err){
     log::log(log::ERROR, log::msg_gfx_spritesheet_invalid_xml_bmp_mismatch, name);
-    return useErrorSpritesheet();
+    return useErrorSpritesheet(colorMode);
   }
 
-  ResourceKey_t newKey = nextResourceKey;
-  ++nextResourceKey;
+  bakeSpriteRuns(sheet);
 
-  spritesheets.emplace(std::make_pair(newKey, std::move(resource)));
+  rasterDeferredDraws();
+  ResourceKey_t newKey = spritesheets.insert(std::move(resource));
 
   std::string addendum{};
   addendum += "[name:key]=[";
@@ -471,30 +1260,153 @@ ResourceKey_t loadSpritesheet(ResourceName_t name)
 
 void unloadSpritesheet(ResourceKey_t sheetKey)
 {
-  auto search = spritesheets.find(sheetKey);
-  if(search == spritesheets.end()){
+  SpritesheetResource* resource = spritesheets.find(sheetKey);
+  if(resource == nullptr){
     log::log(log::WARN, log::msg_gfx_unloading_nonexistent_resource, "key=" + std::to_string(sheetKey));
     return;
   }
 
-  SpritesheetResource& resource = search->second;
-  resource._referenceCount--;
-  if(resource._referenceCount <= 0 && resource._name != errorSpritesheetName){
+  resource->_referenceCount--;
+  if(resource->_referenceCount <= 0 && resource->_name != errorSpritesheetName && 
+     resource->_name != errorPaletteSpritesheetName){
+    rasterDeferredDraws();
     log::log(log::INFO, log::msg_gfx_unload_spritesheet_success, "key=" + std::to_string(sheetKey));
-    spritesheets.erase(search);
+    spritesheets.erase(sheetKey);
+  }
+}
+
+static ResourceKey_t useErrorSpriteMask()
+{
+  assert(spriteMasks.isValid(errorSpriteMaskKey)); // else the error mask has not been generated.
+
+  SpriteMaskResource& resource = spriteMasks[errorSpriteMaskKey];
+  resource._referenceCount++;
+  std::string addendum = "ref count=" + std::to_string(resource._referenceCount);
+  log::log(log::INFO, log::msg_gfx_using_error_spritemask, addendum);
+  return errorSpriteMaskKey;
+}
+
+//
+// Parses the rows of a mask file (see loadSpriteMask) and packs them into the mask. Returns
+// false if the file is not a valid mask.
+//
+static bool parseSpriteMask(std::ifstream& file, SpriteMask& mask)
+{
+  std::vector<std::string> rows {};
+  std::string line {};
+  while(std::getline(file, line)){
+    line.erase(line.find_last_not_of(" \t\r") + 1);
+    if(line.empty())
+      continue;
+    if(line.find_first_not_of("01") != std::string::npos)
+      return false;
+    if(!rows.empty() && line.size() != rows.front().size())
+      return false;
+    rows.push_back(std::move(line));
+  }
+
+  if(rows.empty())
+    return false;
+
+  mask._size = Vector2i{static_cast<int>(rows.front().size()), static_cast<int>(rows.size())};
+  mask._wordsPerRow = (mask._size._x + 63) / 64;
+  mask._words.assign(mask._wordsPerRow * mask._size._y, 0);
+
+  for(int row = 0; row < mask._size._y; ++row){
+    const std::string& bits = rows[mask._size._y - 1 - row];    // files are top row first.
+    uint64_t* words = mask._words.data() + (row * mask._wordsPerRow);
+    for(int col = 0; col < mask._size._x; ++col)
+      if(bits[col] == '1')
+        words[col / 64] |= 1ull << (col % 64);
+  }
+
+  return true;
+}
+
+ResourceKey_t loadSpriteMask(ResourceName_t name)
+{
+  log::log(log::INFO, log::msg_gfx_loading_spritemask, name);
+
+  ResourceKey_t loadedKey {spriteMasks.NULL_HANDLE};
+  spriteMasks.forEach([&loadedKey, name](ResourceKey_t maskKey, SpriteMaskResource& resource){
+    if(resource._name == name)
+      loadedKey = maskKey;
+  });
+
+  if(loadedKey != spriteMasks.NULL_HANDLE){
+    SpriteMaskResource& resource = spriteMasks[loadedKey];
+    resource._referenceCount++;
+    std::string addendum {"ref count="};
+    addendum += std::to_string(resource._referenceCount);
+    log::log(log::INFO, log::msg_gfx_spritemask_already_loaded, addendum);
+    return loadedKey;
+  }
+
+  SpriteMaskResource resource{};
+  resource._name = name;
+  resource._referenceCount = 1;
+
+  std::string maskpath{};
+  maskpath += RESOURCE_PATH_SPRITEMASKS;
+  maskpath += name;
+  maskpath += RESOURCE_EXTENSION_SPRITEMASKS;
+  std::ifstream file{maskpath};
+  if(!file){
+    log::log(log::ERROR, log::msg_gfx_fail_open_spritemask, maskpath);
+    return useErrorSpriteMask();
+  }
+
+  if(!parseSpriteMask(file, resource._mask)){
+    log::log(log::ERROR, log::msg_gfx_spritemask_invalid, name);
+    return useErrorSpriteMask();
+  }
+
+  rasterDeferredDraws();
+  ResourceKey_t newKey = spriteMasks.insert(std::move(resource));
+
+  std::string addendum{};
+  addendum += "[name:key]=[";
+  addendum += name; 
+  addendum += ":"; 
+  addendum += std::to_string(newKey);
+  addendum += "]";
+  log::log(log::INFO, log::msg_gfx_loading_spritemask_success, addendum);
+
+  return newKey;
+}
+
+void unloadSpriteMask(ResourceKey_t maskKey)
+{
+  SpriteMaskResource* resource = spriteMasks.find(maskKey);
+  if(resource == nullptr){
+    log::log(log::WARN, log::msg_gfx_unloading_nonexistent_resource, "key=" + std::to_string(maskKey));
+    return;
+  }
+
+  resource->_referenceCount--;
+  if(resource->_referenceCount <= 0 && resource->_name != errorSpriteMaskName){
+    rasterDeferredDraws();
+    log::log(log::INFO, log::msg_gfx_unload_spritemask_success, "key=" + std::to_string(maskKey));
+    spriteMasks.erase(maskKey);
   }
 }
 
-ResourceKey_t loadFont(ResourceName_t name)
+ResourceKey_t loadFont(ResourceName_t name, ColorMode colorMode)
 {
   log::log(log::INFO, log::msg_gfx_loading_font, name);
 
-  for(auto& resource : fonts){
-    if(resource.second._name == name){
-      log::log(log::INFO, log::msg_gfx_loading_font_success);
-      resource.second._referenceCount++;
-      return resource.first;
-    }
+  bool isPalette = colorMode == ColorMode::PALETTE8;
+
+  ResourceKey_t loadedKey {fonts.NULL_HANDLE};
+  fonts.forEach([&loadedKey, name, isPalette](ResourceKey_t fontKey, FontResource& resource){
+    if(resource._name == name && resource._font._isPalette == isPalette)
+      loadedKey = fontKey;
+  });
+
+  if(loadedKey != fonts.NULL_HANDLE){
+    log::log(log::INFO, log::msg_gfx_loading_font_success);
+    fonts[loadedKey]._referenceCount++;
+    return loadedKey;
   }
 
   FontResource resource {};
@@ -509,39 +1421,43 @@ ResourceKey_t loadFont(ResourceName_t name)
   bmppath += Bmp::FILE_EXTENSION;
   if(!resource._font._image.load(bmppath)){
     log::log(log::ERROR, log::msg_gfx_fail_load_asset_bmp, name);
-    return useErrorFont();
+    return useErrorFont(colorMode);
   }
 
+  if(isPalette && !indexPaletteImage(font._image, name))
+    return useErrorFont(colorMode);
+  font._isPalette = isPalette;
+
   std::string xmlpath {};
   xmlpath += RESOURCE_PATH_FONTS;
   xmlpath += name;
   xmlpath += XML_RESOURCE_EXTENSION_FONTS;
   XMLDocument doc{};
   if(!parseXmlDocument(&doc, xmlpath))
-    return useErrorFont();
+    return useErrorFont(colorMode);
 
   XMLElement* xmlfont{nullptr};
   XMLElement* xmlcommon{nullptr};
   XMLElement* xmlchars{nullptr};
   XMLElement* xmlchar{nullptr};
 
-  if(!extractChildElement(&doc, &xmlfont, "font")) return useErrorFont();
-  if(!extractChildElement(xmlfont, &xmlcommon, "common")) return useErrorFont();
-  if(!extractIntAttribute(xmlcommon, "lineHeight", &font._lineHeight)) return useErrorFont();
-  if(!extractIntAttribute(xmlcommon, "baseline", &font._baseLine)) return useErrorFont();
-  if(!extractIntAttribute(xmlcommon, "glyphspace", &font._glyphSpace)) return useErrorFont();
+  if(!extractChildElement(&doc, &xmlfont, "font")) return useErrorFont(colorMode);
+  if(!extractChildElement(xmlfont, &xmlcommon, "common")) return useErrorFont(colorMode);
+  if(!extractIntAttribute(xmlcommon, "lineHeight", &font._lineHeight)) return useErrorFont(colorMode);
+  if(!extractIntAttribute(xmlcommon, "baseline", &font._baseLine)) return useErrorFont(colorMode);
+  if(!extractIntAttribute(xmlcommon, "glyphspace", &font._glyphSpace)) return useErrorFont(colorMode);
 
   int charsCount {0};
-  if(!extractChildElement(xmlfont, &xmlchars, "chars")) return useErrorFont();
-  if(!extractIntAttribute(xmlchars, "count", &charsCount)) return useErrorFont();
+  if(!extractChildElement(xmlfont, &xmlchars, "chars")) return useErrorFont(colorMode);
+  if(!extractIntAttribute(xmlchars, "count", &charsCount)) return useErrorFont(colorMode);
 
   if(charsCount != ASCII_CHAR_COUNT){
     log::log(log::ERROR, log::msg_gfx_missing_ascii_glyphs, name);
-    return useErrorFont();
+    return useErrorFont(colorMode);
   }
 
   int charsRead{0}, err{0};
-  if(!extractChildElement(xmlchars, &xmlchar, "char")) return useErrorFont();
+  if(!extractChildElement(xmlchars, &xmlchar, "char")) return useErrorFont(colorMode);
   do{
     Glyph& glyph = font._glyphs[charsRead];
     if(!extractIntAttribute(xmlchar, "ascii", &glyph._ascii)){++err; break;}
@@ -556,7 +1472,7 @@ ResourceKey_t loadFont(ResourceName_t name)
     xmlchar = xmlchar->NextSiblingElement("char");
   }
   while(xmlchar != 0 && charsRead < ASCII_CHAR_COUNT);
-  if(err) return useErrorFont();
+  if(err) return useErrorFont(colorMode);
 
   std::sort(font._glyphs.begin(), font._glyphs.end(), [](const Glyph& g0, const Glyph& g1) {
     return g0._ascii < g1._ascii;
@@ -564,7 +1480,7 @@ ResourceKey_t loadFont(ResourceName_t name)
 
   if(charsRead != ASCII_CHAR_COUNT){
     log::log(log::ERROR, log::msg_gfx_missing_ascii_glyphs, name);
-    return useErrorFont();
+    return useErrorFont(colorMode);
   }
 
   // 
@@ -582,7 +1498,7 @@ ResourceKey_t loadFont(ResourceName_t name)
 
   if(err){
     log::log(log::ERROR, log::msg_gfx_font_invalid_xml_bmp_mismatch);
-    return useErrorFont();
+    return useErrorFont(colorMode);
   }
 
   //
@@ -595,167 +1511,314 @@ ResourceKey_t loadFont(ResourceName_t name)
   }
   if(checksum != ASCII_CHAR_CHECKSUM){
     log::log(log::ERROR, log::msg_gfx_font_fail_checksum);
-    return useErrorFont();
+    return useErrorFont(colorMode);
   }
 
   log::log(log::INFO, log::msg_gfx_loading_font_success);
 
-  ResourceKey_t newKey = nextResourceKey;
-  ++nextResourceKey;
-
-  fonts.emplace(std::make_pair(newKey, std::move(resource)));
-
-  return newKey;
+  rasterDeferredDraws();
+  return fonts.insert(std::move(resource));
 }
 
 void unloadFont(ResourceKey_t fontKey)
 {
-  auto search = fonts.find(fontKey);
-  if(search == fonts.end()){
+  FontResource* resource = fonts.find(fontKey);
+  if(resource == nullptr){
     log::log(log::WARN, log::msg_gfx_unloading_nonexistent_resource, "font" + std::to_string(fontKey));
     return;
   }
 
-  FontResource& resource = search->second;
-  resource._referenceCount--;
-  if(resource._referenceCount <= 0 && resource._name != errorFontName){
+  resource->_referenceCount--;
+  if(resource->_referenceCount <= 0 && resource->_name != errorFontName && 
+     resource->_name != errorPaletteFontName){
+    rasterDeferredDraws();
+    evictTextRuns(fontKey);
     log::log(log::INFO, log::msg_gfx_unload_font_success, "key=" + std::to_string(fontKey));
-    fonts.erase(search);
+    fonts.erase(fontKey);
   }
 }
 
 int getSpriteCount(ResourceKey_t sheetKey)
 {
-  auto search = spritesheets.find(sheetKey);
-  assert(search != spritesheets.end());
-  return search->second._sheet._sprites.size();
+  return spritesheets[sheetKey]._sheet._sprites.size();
 }
 
 void onWindowResize(Vector2i windowSize)
 {
+  pxr::gfx::windowSize = windowSize;
   setViewport(iRect{0, 0, windowSize._x, windowSize._y});
   for(auto& screen : screens)
     autoAdjustScreen(windowSize, screen);
+  if(presentMode == PresentMode::COMPOSITE){
+    freeComposite();
+    createComposite();
+  }
 }
 
 void clearWindowColor(Color4f color)
 {
+  if(backend == Backend::HEADLESS)
+    return;
   glClearColor(color._r, color._g, color._b, color._a); 
   glClear(GL_COLOR_BUFFER_BIT);
 }
 
-void clearScreenTransparent(int screenid)
+//
+// The state a draw is rasterised with. Immediate draws target the whole screen. Deferred draws
+// target a tile (a band of rows) of the screen with the shader state captured when the draw
+// was recorded.
+//
+struct RasterTarget
 {
-  assert(0 <= screenid && screenid < screens.size());
-  memset(screens[screenid]._pxColors, ALPHA_KEY, screens[screenid]._pxCount * sizeof(Color4u));
+  Color4u*     _pxColors;
+  int          _pitch;       // pixels per row of _pxColors.
+  int          _xmin;        // bounds of the region which may be written (inclusive).
+  int          _ymin;
+  int          _xmax;
+  int          _ymax;
+  bool         _shader;
+  PXShader_t   _pxShader;
+  SpanShader_t _spanShader;
+  PaletteIndex_t* _pxIndices;  // if not null, the target is a PALETTE8 screen and is written
+                               // in place of _pxColors.
+};
+
+static RasterTarget screenTarget(const Screen& screen)
+{
+  RasterTarget target;
+  target._pxColors = screen._pxColors;
+  target._pxIndices = screen._pxIndices;
+  target._pitch = screen._resolution._x;
+  target._xmin = 0;
+  target._ymin = 0;
+  target._xmax = screen._resolution._x - 1;
+  target._ymax = screen._resolution._y - 1;
+  target._shader = screen._xmode == PixelMode::SHADER;
+  target._pxShader = screen._pxShader;
+  target._spanShader = screen._spanShader;
+  return target;
 }
 
-void clearScreenShade(int shade, int screenid)
+//
+// The region of a block of pixels, e.g. a sprite or glyph, visible on a target. Rows and
+// columns are w.r.t the block's local space; the visible region is [colBegin, colEnd) x
+// [rowBegin, rowEnd).
+//
+struct BlockClip
 {
-  assert(0 <= screenid && screenid < screens.size());
-  shade = std::max(0, std::min(shade, 255));
-  memset(screens[screenid]._pxColors, shade, screens[screenid]._pxCount * sizeof(Color4u));
+  int _colBegin;
+  int _colEnd;
+  int _rowBegin;
+  int _rowEnd;
+};
+
+//
+// Clips a block of size [w, h] with its bottom-left pixel at screen position [x, y] against
+// the target. Returns false if no part of the block is visible.
+//
+static bool clipBlock(const RasterTarget& target, int x, int y, int w, int h, BlockClip& clip)
+{
+  clip._colBegin = std::max(0, target._xmin - x);
+  clip._colEnd = std::min(w, target._xmax + 1 - x);
+  clip._rowBegin = std::max(0, target._ymin - y);
+  clip._rowEnd = std::min(h, target._ymax + 1 - y);
+  return clip._colBegin < clip._colEnd && clip._rowBegin < clip._rowEnd;
 }
 
-void clearScreenColor(Color4u color, int screenid)
+//
+// The rasterisers below are templated on the draw call state which would otherwise be tested
+// per pixel (the pixel mode, clipping and the pixel type of the target). Each render function
+// tests the state once and dispatches to the matching instantiation, leaving the pixel loops
+// free of mode branches. The pixel type is Color4u for FULL_RGB screens and PaletteIndex_t 
+// for PALETTE8 screens; palette screens are never shaded.
+//
+
+template<typename Pixel>
+static inline Pixel* targetPixels(const RasterTarget& target)
 {
-  assert(0 <= screenid && screenid < screens.size());
-  Screen& screen = screens[screenid];
-  for(int px = 0; px < screen._pxCount; ++px)
-    screen._pxColors[px] = color;
+  if constexpr(std::is_same_v<Pixel, PaletteIndex_t>)
+    return target._pxIndices;
+  else
+    return target._pxColors;
 }
 
-void drawSprite(Vector2i position, ResourceKey_t sheetKey, int spriteid, int screenid, 
-                bool mirrorX, bool mirrorY)
+template<typename Pixel>
+static inline Pixel toPixel(Color4u color)
 {
-  assert(0 <= screenid && screenid < screens.size());
-  auto& screen = screens[screenid];
+  if constexpr(std::is_same_v<Pixel, PaletteIndex_t>)
+    return toPaletteIndex(color);
+  else
+    return color;
+}
 
-  auto search = spritesheets.find(sheetKey);
-  if(search == spritesheets.end()){
-    assert(0);
+//
+// Shades a span of pixels in place with the shader of the target. Pixel shaders are adapted
+// to spans by calling them for each pixel in turn.
+//
+static inline void shadeSpan(const RasterTarget& target, Color4u* colors, int count, int x, int y)
+{
+  if(target._spanShader != nullptr){
+    target._spanShader(colors, count, x, y);
+    return;
   }
-  const auto& sheet = search->second._sheet;
-  const Color4u* const * sheetPxs = sheet._image.getPixels();
+  for(int i = 0; i < count; ++i)
+    colors[i] = target._pxShader(colors[i], x + i, y);
+}
 
-  assert(0 <= spriteid);
+template<bool Shader>
+static inline Color4u shade(const RasterTarget& target, Color4u color, int x, int y)
+{
+  if constexpr(Shader)
+    shadeSpan(target, &color, 1, x, y);
+  return color;
+}
 
-  if(sheetKey == errorSpritesheetKey)
-    spriteid = (spriteid < sheet._sprites.size()) ? spriteid : 0;
-  else
-    assert(spriteid < sheet._sprites.size());
+template<bool Shader, typename Pixel>
+static inline void writePixel(const RasterTarget& target, int x, int y, Color4u color)
+{
+  targetPixels<Pixel>(target)[x + (y * target._pitch)] = toPixel<Pixel>(shade<Shader>(target, color, x, y));
+}
 
-  auto& sprite = sheet._sprites[spriteid];
+//
+// Writes a run of 'count' opaque src pixels to dst. [x, y] is the screen position of the first
+// dst pixel.
+//
+template<bool Shader, typename Pixel>
+static inline void writeRun(const RasterTarget& target, Pixel* dst, const Pixel* src, int count, int x, int y)
+{
+  std::copy_n(src, count, dst);
+  if constexpr(Shader)
+    shadeSpan(target, dst, count, x, y);
+}
 
-  int screenRow {0}, screenCol{0}, screenRowOffset{0}, screenRowBase{0}, screenColBase{0},
-      spriteRowOffset{0}, spriteColOffset{0}, spriteRowMax{0}, spriteColMax{0};
-  screenRowBase = position._y - sprite._origin._y;
-  screenColBase = position._x - sprite._origin._x;
-  spriteRowMax = sprite._size._y - 1;
-  spriteColMax = sprite._size._x - 1;
-  for(int spriteRow = 0; spriteRow <= spriteRowMax; ++spriteRow){
-    screenRow = screenRowBase + spriteRow;
-    if(screenRow < 0) continue;
-    if(screenRow >= screen._resolution._y) break;
-    screenRowOffset = screenRow * screen._resolution._x;
-    spriteRowOffset = sprite._position._y + (mirrorY ? spriteRowMax - spriteRow : spriteRow); 
-    for(int spriteCol = 0; spriteCol <= spriteColMax; ++spriteCol){
-      screenCol = screenColBase + spriteCol;
-      if(screenCol < 0) continue;
-      if(screenCol >= screen._resolution._x) break;
-      spriteColOffset = sprite._position._x + (mirrorX ? spriteColMax - spriteCol : spriteCol); 
-      const Color4u& color = sheetPxs[spriteRowOffset][spriteColOffset];
-      if(color._a == ALPHA_KEY) continue;
-      screen._pxColors[screenCol + screenRowOffset] =
-        (screen._xmode == PixelMode::SHADER) ? screen._pxShader(color, screenCol, screenRow) : color;
-    }
-  }
+//
+// Writes a row of 'count' pixels of a single color to dst. [x, y] is the screen position of
+// the first dst pixel.
+//
+template<bool Shader, typename Pixel>
+static inline void writeRowFill(const RasterTarget& target, Pixel* dst, Color4u color, int count, int x, int y)
+{
+  if constexpr(std::is_same_v<Pixel, PaletteIndex_t>)
+    memset(dst, toPaletteIndex(color), count);
+  else
+    blitRowFill(dst, color, count);
+  if constexpr(Shader)
+    shadeSpan(target, dst, count, x, y);
 }
 
-void drawSpriteColumn(Vector2i position, ResourceKey_t sheetKey, int spriteid, int colid, int screenid)
+//
+// Fills the (unshaded) block of pixels [x0, x1] x [y0, y1]; bounds must be within the target.
+// Blocks spanning full rows are contiguous and so are filled as a single span.
+//
+template<typename Pixel>
+static void fillBlock(const RasterTarget& target, int x0, int y0, int x1, int y1, Color4u color)
 {
-  assert(0 <= screenid && screenid < screens.size());
-  auto& screen = screens[screenid];
+  int count = x1 - x0 + 1;
+  Pixel* dst = targetPixels<Pixel>(target) + x0 + (y0 * target._pitch);
+  if(count == target._pitch){
+    writeRowFill<false, Pixel>(target, dst, color, count * (y1 - y0 + 1), x0, y0);
+    return;
+  }
+  for(int y = y0; y <= y1; ++y, dst += target._pitch)
+    writeRowFill<false, Pixel>(target, dst, color, count, x0, y);
+}
 
-  auto search = spritesheets.find(sheetKey);
-  assert(search != spritesheets.end());
-  const auto& sheet = search->second._sheet;
-  const Color4u* const * sheetPxs = sheet._image.getPixels();
+//
+// The opaque runs of a block of pixels, i.e. of a sprite or a cached text string.
+//
+struct RunBlock
+{
+  const SpriteRunRow* _runRows;
+  const SpriteRun* _runs;
+  const Color4u* _runPixels;
+  const PaletteIndex_t* _runIndices;
+  Vector2i _size;
+};
 
-  assert(0 <= spriteid);
-  spriteid = spriteid < sheet._sprites.size() ? spriteid : 0; // may be an error sheet with 1 sprite.
-  auto& sprite = sheet._sprites[spriteid];
+//
+// Draws the runs of a block. A fully visible block (Clipped=false) skips clipping the runs.
+//
+template<bool Shader, bool Clipped, typename Pixel>
+static void rasterRuns(const RasterTarget& target, const RunBlock& block, int screenColBase, int screenRowBase,
+                       const BlockClip& clip)
+{
+  const SpriteRunRow* runRows = block._runRows;
+  const SpriteRun* runs = block._runs;
+  const Pixel* runPixels;
+  if constexpr(std::is_same_v<Pixel, PaletteIndex_t>)
+    runPixels = block._runIndices;
+  else
+    runPixels = block._runPixels;
+
+  for(int spriteRow = clip._rowBegin; spriteRow < clip._rowEnd; ++spriteRow){
+    int screenRow = screenRowBase + spriteRow;
+    Pixel* dst = targetPixels<Pixel>(target) + screenColBase + (screenRow * target._pitch);
+    const SpriteRunRow& runRow = runRows[spriteRow];
+    for(int i = runRow._begin; i < runRow._end; ++i){
+      const SpriteRun& run = runs[i];
+      int colBegin = run._col;
+      int colEnd = run._col + run._length;
+      const Pixel* src = runPixels + run._pixels;
+      if constexpr(Clipped){
+        if(colBegin < clip._colBegin){
+          src += clip._colBegin - colBegin;
+          colBegin = clip._colBegin;
+        }
+        colEnd = std::min(colEnd, clip._colEnd);
+        if(colBegin >= colEnd) 
+          continue;
+      }
+      writeRun<Shader, Pixel>(target, dst + colBegin, src, colEnd - colBegin, screenColBase + colBegin, screenRow);
+    }
+  }
+}
 
-  colid = std::clamp(colid, 0, sprite._size._x);
+using RunRaster_t = void (*)(const RasterTarget&, const RunBlock&, int, int, const BlockClip&);
 
-  int screenRow {0}, screenCol{0}, screenRowOffset{0}, sheetCol{0};
+enum RunRasterBits
+{
+  RUN_RASTER_SHADER   = 1 << 0,
+  RUN_RASTER_CLIPPED  = 1 << 1,
+  RUN_RASTER_INDEXED  = 1 << 2,
+  RUN_RASTER_COUNT    = 1 << 3
+};
 
-  screenCol = position._x + colid;
-  sheetCol = sprite._position._x + colid;
+//
+// Indexed (palette) targets are never shaded so the indexed instantiations ignore the shader
+// bit.
+//
+template<std::size_t... Bits>
+static constexpr std::array<RunRaster_t, sizeof...(Bits)> makeRunRasters(std::index_sequence<Bits...>)
+{
+  return {{&rasterRuns<(Bits & RUN_RASTER_SHADER) != 0 && (Bits & RUN_RASTER_INDEXED) == 0,
+                       (Bits & RUN_RASTER_CLIPPED) != 0,
+                       std::conditional_t<(Bits & RUN_RASTER_INDEXED) != 0, PaletteIndex_t, Color4u>>...}};
+}
 
-  if(screenCol < 0 || screenCol >= screen._resolution._x) 
-    return;
+//
+// All instantiations of the run rasteriser indexed by a combination of RunRasterBits.
+//
+static constexpr std::array<RunRaster_t, RUN_RASTER_COUNT> runRasters {
+  makeRunRasters(std::make_index_sequence<RUN_RASTER_COUNT>{})
+};
 
-  for(int spriteRow = 0; spriteRow < sprite._size._y; ++spriteRow){
-    screenRow = position._y + spriteRow;
-    if(screenRow < 0) continue;
-    if(screenRow >= screen._resolution._y) break;
-    screenRowOffset = screenRow * screen._resolution._x;
-    const Color4u& color = sheetPxs[sprite._position._y + spriteRow][sheetCol];
+template<bool Shader, typename Pixel>
+static void rasterSpriteColumn(const RasterTarget& target, const Color4u* const* sheetPxs, int sheetCol, 
+                               int sheetRowBase, int screenCol, int screenRowBase, const BlockClip& clip)
+{
+  Pixel* dst = targetPixels<Pixel>(target) + screenCol + ((screenRowBase + clip._rowBegin) * target._pitch);
+  for(int spriteRow = clip._rowBegin; spriteRow < clip._rowEnd; ++spriteRow, dst += target._pitch){
+    const Color4u& color = sheetPxs[sheetRowBase + spriteRow][sheetCol];
     if(color._a == ALPHA_KEY) continue;
-    screen._pxColors[screenCol + screenRowOffset] =
-      (screen._xmode == PixelMode::SHADER) ? screen._pxShader(color, screenCol, screenRow) : color;
+    *dst = toPixel<Pixel>(shade<Shader>(target, color, screenCol, screenRowBase + spriteRow));
   }
 }
 
-void drawText(Vector2i position, const std::string& text, ResourceKey_t fontKey, int screenid)
+//
+// Composites the glyphs of a text string onto the target; used to bake text runs.
+//
+static void compositeText(const RasterTarget& target, Vector2i position, std::string_view text, const Font& font)
 {
-  assert(0 <= screenid && screenid < screens.size());
-  auto& screen = screens[screenid];
-
-  auto search = fonts.find(fontKey);
-  assert(search != fonts.end());
-  auto& font = search->second._font;
   const Color4u* const* fontPxs = font._image.getPixels();
 
   int baseLineY = position._y + font._baseLine;
@@ -763,184 +1826,1559 @@ void drawText(Vector2i position, const std::string& text, ResourceKey_t fontKey,
     if(c == '\n') continue;
     assert(' ' <= c && c <= '~');
     const Glyph& glyph = font._glyphs[static_cast<int>(c - ' ')];
-    int screenRow{0}, screenCol{0}, screenRowBase{0}, screenRowOffset {0};
-    screenRowBase = baseLineY + glyph._yoffset;
-    for(int glyphRow = 0; glyphRow < glyph._height; ++glyphRow){
-      screenRow = screenRowBase + glyphRow;
-      if(screenRow < 0) continue;
-      if(screenRow >= screen._resolution._y) break;
-      screenRowOffset = screenRow * screen._resolution._x;
-      for(int glyphCol = 0; glyphCol < glyph._width; ++glyphCol){
-        screenCol = position._x + glyphCol + glyph._xoffset;
-        if(screenCol < 0) continue;
-        if(screenCol >= screen._resolution._x) return;
-        const Color4u& color = fontPxs[glyph._y + glyphRow][glyph._x + glyphCol];
-        if(color._a == ALPHA_KEY) continue;
-        screen._pxColors[screenCol + screenRowOffset] =
-          (screen._xmode == PixelMode::SHADER) ? screen._pxShader(color, screenCol, screenRow) : color;
-      }
-    }
+    int screenColBase = position._x + glyph._xoffset;
+    int screenRowBase = baseLineY + glyph._yoffset;
     position._x += glyph._xadvance + font._glyphSpace;
+
+    BlockClip clip;
+    if(!clipBlock(target, screenColBase, screenRowBase, glyph._width, glyph._height, clip))
+      continue;
+
+    int count = clip._colEnd - clip._colBegin;
+    int screenCol = screenColBase + clip._colBegin;
+    for(int glyphRow = clip._rowBegin; glyphRow < clip._rowEnd; ++glyphRow){
+      int screenRow = screenRowBase + glyphRow;
+      Color4u* dst = target._pxColors + screenCol + (screenRow * target._pitch);
+      const Color4u* src = fontPxs[glyph._y + glyphRow] + glyph._x + clip._colBegin;
+      blitRowKeyed(dst, src, count);
+    }
   }
 }
 
-void drawBorderRectangle(iRect rect, Color4u color, int screenid)
+template<bool Shader, typename Pixel>
+static void rasterBorderRectangle(const RasterTarget& target, int xmin, int ymin, int xmax, int ymax, Color4u color)
 {
-  assert(0 <= screenid && screenid < screens.size());
-  auto& screen = screens[screenid];
-
-  int xmin = std::clamp(rect._x,           0, screen._resolution._x - 1);
-  int xmax = std::clamp(rect._x + rect._w, 0, screen._resolution._x - 1);
-  int ymin = std::clamp(rect._y,           0, screen._resolution._y - 1);
-  int ymax = std::clamp(rect._y + rect._h, 0, screen._resolution._y - 1);
+  int x0 = std::max(xmin, target._xmin);
+  int x1 = std::min(xmax, target._xmax);
+  int y0 = std::max(ymin, target._ymin);
+  int y1 = std::min(ymax, target._ymax);
+  if(x0 > x1 || y0 > y1)
+    return;
 
-  for(int x = xmin; x <= xmax; ++x){
-    screen._pxColors[x + (ymin * screen._resolution._x)] = 
-      (screen._xmode == PixelMode::SHADER) ? screen._pxShader(color, x, ymin) : color;
-    screen._pxColors[x + (ymax * screen._resolution._x)] = 
-      (screen._xmode == PixelMode::SHADER) ? screen._pxShader(color, x, ymax) : color;
-  }
+  Pixel* pixels = targetPixels<Pixel>(target);
+  if(ymin == y0)
+    writeRowFill<Shader, Pixel>(target, pixels + x0 + (ymin * target._pitch), color, x1 - x0 + 1, x0, ymin);
+  if(ymax == y1)
+    writeRowFill<Shader, Pixel>(target, pixels + x0 + (ymax * target._pitch), color, x1 - x0 + 1, x0, ymax);
 
-  for(int y = ymin; y <= ymax; ++y){
-    screen._pxColors[xmin + (y * screen._resolution._x)] = 
-      (screen._xmode == PixelMode::SHADER) ? screen._pxShader(color, xmin, y) : color;
-    screen._pxColors[xmax + (y * screen._resolution._x)] = 
-      (screen._xmode == PixelMode::SHADER) ? screen._pxShader(color, xmax, y) : color;
+  for(int y = y0; y <= y1; ++y){
+    if(xmin == x0) writePixel<Shader, Pixel>(target, xmin, y, color);
+    if(xmax == x1) writePixel<Shader, Pixel>(target, xmax, y, color);
   }
 }
 
-void drawFillRectangle(iRect rect, Color4u color, int screenid)
+template<bool Shader, typename Pixel>
+static void rasterFillRectangle(const RasterTarget& target, int xmin, int ymin, int xmax, int ymax, Color4u color)
 {
-  assert(0 <= screenid && screenid < screens.size());
-  auto& screen = screens[screenid];
+  int x0 = std::max(xmin, target._xmin);
+  int x1 = std::min(xmax, target._xmax);
+  int y0 = std::max(ymin, target._ymin);
+  int y1 = std::min(ymax, target._ymax);
+  if(x0 > x1 || y0 > y1)
+    return;
 
-  int xmin = std::clamp(rect._x,           0, screen._resolution._x - 1);
-  int xmax = std::clamp(rect._x + rect._w, 0, screen._resolution._x - 1);
-  int ymin = std::clamp(rect._y,           0, screen._resolution._y - 1);
-  int ymax = std::clamp(rect._y + rect._h, 0, screen._resolution._y - 1);
+  if constexpr(!Shader){
+    fillBlock<Pixel>(target, x0, y0, x1, y1, color);
+    return;
+  }
 
-  for(int x = xmin; x <= xmax; ++x)
-    for(int y = ymin; y <= ymax; ++y)
-      screen._pxColors[x + (y * screen._resolution._x)] = 
-        (screen._xmode == PixelMode::SHADER) ? screen._pxShader(color, x, ymin) : color;
+  int count = x1 - x0 + 1;
+  for(int y = y0; y <= y1; ++y)
+    writeRowFill<Shader, Pixel>(target, targetPixels<Pixel>(target) + x0 + (y * target._pitch), color, count, x0, y);
 }
 
-void drawLine(Vector2i p0, Vector2i p1, Color4u color, int screenid)
+//
+// Rasterises a line with integer Bresenham; both end points are drawn. The end points must be
+// within the screen (see clipLine) but may be outside the rows of the target (a tile), in
+// which case the rows of the target are written exactly as had the whole line been drawn.
+//
+template<bool Shader, typename Pixel>
+static void rasterLine(const RasterTarget& target, Vector2i p0, Vector2i p1, Color4u color)
 {
-  assert(0 <= screenid && screenid < screens.size());
-  auto& screen = screens[screenid];
-
-  p0._x = std::clamp(p0._x, 0, screen._resolution._x - 1);
-  p1._x = std::clamp(p1._x, 0, screen._resolution._x - 1);
-  p0._y = std::clamp(p0._y, 0, screen._resolution._y - 1);
-  p1._y = std::clamp(p1._y, 0, screen._resolution._y - 1);
-
   //
-  // constants in line equation y=mx+c
+  // Lines are always stepped with y increasing so the pixels of a line do not depend on the
+  // order of its end points and the rows below the target can be skipped.
   //
-  int dx = static_cast<float>(p1._x - p0._x);
-  int dy = static_cast<float>(p1._y - p0._y);
-
-  if(dx == 0 && dy == 0)
+  if(p0._y > p1._y)
+    std::swap(p0, p1);
+
+  if(p0._y == p1._y){
+    if(p0._y < target._ymin || p0._y > target._ymax)
+      return;
+    int x0 = std::max(std::min(p0._x, p1._x), target._xmin);
+    int x1 = std::min(std::max(p0._x, p1._x), target._xmax);
+    if(x0 <= x1)
+      writeRowFill<Shader, Pixel>(target, targetPixels<Pixel>(target) + x0 + (p0._y * target._pitch), color, x1 - x0 + 1, x0, p0._y);
     return;
-
-  int ymin, ymax;
-  if(p0._y < p1._y){
-    ymin = p0._y;
-    ymax = p1._y;
-  }
-  else{
-    ymin = p1._y;
-    ymax = p0._y;
   }
 
-  int xmin, xmax;
-  if(p0._x < p1._x){
-    xmin = p0._x;
-    xmax = p1._x;
-  }
-  else{
-    xmin = p1._x;
-    xmax = p0._x;
+  if(p0._x == p1._x){
+    if(p0._x < target._xmin || p0._x > target._xmax)
+      return;
+    int y0 = std::max(p0._y, target._ymin);
+    int y1 = std::min(p1._y, target._ymax);
+    for(int y = y0; y <= y1; ++y)
+      writePixel<Shader, Pixel>(target, p0._x, y, color);
+    return;
   }
 
-  if(dx == 0)
-    for(int y = ymin; y < ymax; ++y)
-      screen._pxColors[xmin + (y * screen._resolution._x)] = 
-        (screen._xmode == PixelMode::SHADER) ? screen._pxShader(color, xmin, y) : color;
-
-  else if(dy == 0)
-    for(int x = xmin; x < xmax; ++x)
-      screen._pxColors[x + (ymin * screen._resolution._x)] = 
-        (screen._xmode == PixelMode::SHADER) ? screen._pxShader(color, x, ymin) : color;
-
-  else{
-    float m = static_cast<float>(dy) / dx;
-    for(int x = xmin; x <= xmax; ++x){
-      int y = (m * x) + ymin;
-      screen._pxColors[x + (y * screen._resolution._x)] = 
-        (screen._xmode == PixelMode::SHADER) ? screen._pxShader(color, x, y) : color;
+  int dx = std::abs(p1._x - p0._x);
+  int dy = -(p1._y - p0._y);
+  int sx = p0._x < p1._x ? 1 : -1;
+  int error = dx + dy;
+  int x = p0._x;
+  int y = p0._y;
+  while(y <= target._ymax){
+    if(y >= target._ymin && target._xmin <= x && x <= target._xmax)
+      writePixel<Shader, Pixel>(target, x, y, color);
+    if(x == p1._x && y == p1._y)
+      break;
+    int error2 = 2 * error;
+    if(error2 >= dy){
+      error += dy;
+      x += sx;
+    }
+    if(error2 <= dx){
+      error += dx;
+      ++y;
     }
   }
 }
 
-void drawPoint(Vector2i position, Color4u color, int screenid)
+static void renderRuns(const RasterTarget& target, const RunBlock& block, int screenColBase, int screenRowBase)
 {
-  assert(0 <= screenid && screenid < screens.size());
-  auto& screen = screens[screenid];
-
-  int x{position._x}, y{position._y};
-
-  if(x < 0 || x >= screen._resolution._x)
+  BlockClip clip;
+  if(!clipBlock(target, screenColBase, screenRowBase, block._size._x, block._size._y, clip))
     return;
 
-  if(y < 0 || y >= screen._resolution._y)
-    return;
+  bool isClipped = clip._colBegin != 0 || clip._colEnd != block._size._x ||
+                   clip._rowBegin != 0 || clip._rowEnd != block._size._y;
 
-  screen._pxColors[x + (y * screen._resolution._x)] =
-        (screen._xmode == PixelMode::SHADER) ? screen._pxShader(color, x, y) : color;
+  int bits = 0;
+  if(target._shader) bits |= RUN_RASTER_SHADER;
+  if(isClipped) bits |= RUN_RASTER_CLIPPED;
+  if(target._pxIndices != nullptr) bits |= RUN_RASTER_INDEXED;
+
+  runRasters[bits](target, block, screenColBase, screenRowBase, clip);
 }
 
-void present()
+static RunBlock spriteRunBlock(const Spritesheet& sheet, int spriteid, SpriteMirror mirror)
 {
-  for(auto& screen : screens){
-    if(!screen._isEnabled) 
-      continue;
-
-    glVertexPointer(2, GL_INT, 0, screen._pxPositions);
-    glColorPointer(4, GL_UNSIGNED_BYTE, 0, screen._pxColors);
-    glPointSize(screen._pxSize);
-    glDrawArrays(GL_POINTS, 0, screen._pxCount);
-  }
-
-  SDL_GL_SwapWindow(window);
+  RunBlock block;
+  block._runRows = sheet._runRows.data() + sheet._spriteRunRows[(spriteid * MIRROR_COUNT) + mirror];
+  block._runs = sheet._runs.data();
+  block._runPixels = sheet._runPixels.data();
+  block._runIndices = sheet._runIndices.data();
+  block._size = sheet._sprites[spriteid]._size;
+  return block;
 }
 
-void setScreenPixelMode(PixelMode mode, int screenid)
+static RunBlock textRunBlock(const TextRun& textRun)
 {
-  assert(0 <= screenid && screenid < screens.size());
-  screens[screenid]._xmode = mode;
+  RunBlock block;
+  block._runRows = textRun._runRows.data();
+  block._runs = textRun._runs.data();
+  block._runPixels = textRun._runPixels.data();
+  block._runIndices = textRun._runIndices.data();
+  block._size = textRun._size;
+  return block;
 }
 
-void setScreenSizeMode(SizeMode mode, int screenid)
+static void renderSpriteColumn(const RasterTarget& target, const Spritesheet& sheet, int spriteid, int colid,
+                               Vector2i position)
 {
-  assert(0 <= screenid && screenid < screens.size());
-  auto& screen = screens[screenid];
-  screen._smode = mode;
-  autoAdjustScreen(windowSize, screen);
+  const Sprite& sprite = sheet._sprites[spriteid];
+  int screenCol = position._x + colid;
+  int sheetCol = sprite._position._x + colid;
+
+  BlockClip clip;
+  if(!clipBlock(target, screenCol, position._y, 1, sprite._size._y, clip))
+    return;
+
+  const Color4u* const* sheetPxs = sheet._image.getPixels();
+  if(target._pxIndices != nullptr)
+    rasterSpriteColumn<false, PaletteIndex_t>(target, sheetPxs, sheetCol, sprite._position._y, screenCol, position._y, clip);
+  else if(target._shader)
+    rasterSpriteColumn<true, Color4u>(target, sheetPxs, sheetCol, sprite._position._y, screenCol, position._y, clip);
+  else
+    rasterSpriteColumn<false, Color4u>(target, sheetPxs, sheetCol, sprite._position._y, screenCol, position._y, clip);
 }
 
-void setScreenPositionMode(PositionMode mode, int screenid)
+//
+// The bits [begin, end) of a 64-bit word; 0 <= begin <= end <= 64.
+//
+static inline uint64_t bitRange(int begin, int end)
 {
-  assert(0 <= screenid && screenid < screens.size());
-  auto& screen = screens[screenid];
-  screen._pmode = mode;
-  autoAdjustScreen(windowSize, screen);
+  uint64_t belowEnd = end == 64 ? ~0ull : (1ull << end) - 1;
+  uint64_t belowBegin = begin == 64 ? ~0ull : (1ull << begin) - 1;
+  return belowEnd & ~belowBegin;
 }
 
-void setScreenManualPosition(Vector2i position, int screenid)
+//
+// Rasterises the set bits of a mask as fills of the tint. The words of each row are masked to
+// the clipped columns then consumed a run of set bits at a time: a run begins at the lowest set
+// bit, its length is the count of ones from there, and adding the lowest set bit to the word
+// clears the run by carrying through it. Runs which span words are filled in two parts.
+//
+template<bool Shader, typename Pixel>
+static void rasterSpriteMask(const RasterTarget& target, const SpriteMask& mask, int screenColBase,
+                             int screenRowBase, const BlockClip& clip, Color4u tint)
 {
-  assert(0 <= screenid && screenid < screens.size());
+  int wordBegin = clip._colBegin / 64;
+  int wordEnd = (clip._colEnd + 63) / 64;
+  Pixel* pxs = targetPixels<Pixel>(target);
+  for(int row = clip._rowBegin; row < clip._rowEnd; ++row){
+    int screenRow = screenRowBase + row;
+    const uint64_t* words = mask._words.data() + (row * mask._wordsPerRow);
+    for(int word = wordBegin; word < wordEnd; ++word){
+      int wordCol = word * 64;
+      uint64_t bits = words[word] & bitRange(std::max(clip._colBegin - wordCol, 0), 
+                                             std::min(clip._colEnd - wordCol, 64));
+      while(bits != 0){
+        int begin = std::countr_zero(bits);
+        int length = std::countr_one(bits >> begin);
+        int screenCol = screenColBase + wordCol + begin;
+        writeRowFill<Shader, Pixel>(target, pxs + screenCol + (screenRow * target._pitch), tint, length, 
+                                    screenCol, screenRow);
+        bits &= bits + (1ull << begin);
+      }
+    }
+  }
+}
+
+static void renderSpriteMask(const RasterTarget& target, const SpriteMask& mask, Vector2i position, Color4u tint)
+{
+  BlockClip clip;
+  if(!clipBlock(target, position._x, position._y, mask._size._x, mask._size._y, clip))
+    return;
+
+  if(target._pxIndices != nullptr)
+    rasterSpriteMask<false, PaletteIndex_t>(target, mask, position._x, position._y, clip, tint);
+  else if(target._shader)
+    rasterSpriteMask<true, Color4u>(target, mask, position._x, position._y, clip, tint);
+  else
+    rasterSpriteMask<false, Color4u>(target, mask, position._x, position._y, clip, tint);
+}
+
+static void renderBorderRectangle(const RasterTarget& target, int xmin, int ymin, int xmax, int ymax, Color4u color)
+{
+  if(target._pxIndices != nullptr)
+    rasterBorderRectangle<false, PaletteIndex_t>(target, xmin, ymin, xmax, ymax, color);
+  else if(target._shader)
+    rasterBorderRectangle<true, Color4u>(target, xmin, ymin, xmax, ymax, color);
+  else
+    rasterBorderRectangle<false, Color4u>(target, xmin, ymin, xmax, ymax, color);
+}
+
+static void renderFillRectangle(const RasterTarget& target, int xmin, int ymin, int xmax, int ymax, Color4u color)
+{
+  if(target._pxIndices != nullptr)
+    rasterFillRectangle<false, PaletteIndex_t>(target, xmin, ymin, xmax, ymax, color);
+  else if(target._shader)
+    rasterFillRectangle<true, Color4u>(target, xmin, ymin, xmax, ymax, color);
+  else
+    rasterFillRectangle<false, Color4u>(target, xmin, ymin, xmax, ymax, color);
+}
+
+//
+// Expects end points already clipped to the screen.
+//
+static void renderLine(const RasterTarget& target, Vector2i p0, Vector2i p1, Color4u color)
+{
+  if(target._pxIndices != nullptr)
+    rasterLine<false, PaletteIndex_t>(target, p0, p1, color);
+  else if(target._shader)
+    rasterLine<true, Color4u>(target, p0, p1, color);
+  else
+    rasterLine<false, Color4u>(target, p0, p1, color);
+}
+
+//
+// Renders 'count' lines from consecutive pairs of end points.
+//
+static void renderLines(const RasterTarget& target, const Vector2i* points, int count, Color4u color)
+{
+  for(int i = 0; i < count; ++i)
+    renderLine(target, points[2 * i], points[(2 * i) + 1], color);
+}
+
+static void renderPoint(const RasterTarget& target, Vector2i position, Color4u color)
+{
+  int x{position._x}, y{position._y};
+  if(x < target._xmin || x > target._xmax || y < target._ymin || y > target._ymax)
+    return;
+
+  if(target._pxIndices != nullptr)
+    writePixel<false, PaletteIndex_t>(target, x, y, color);
+  else if(target._shader)
+    writePixel<true, Color4u>(target, x, y, color);
+  else
+    writePixel<false, Color4u>(target, x, y, color);
+}
+
+//
+// Clears are never shaded.
+//
+static void renderClear(const RasterTarget& target, Color4u color)
+{
+  if(target._pxIndices != nullptr)
+    fillBlock<PaletteIndex_t>(target, target._xmin, target._ymin, target._xmax, target._ymax, color);
+  else
+    fillBlock<Color4u>(target, target._xmin, target._ymin, target._xmax, target._ymax, color);
+}
+
+static void renderFillRectangles(const RasterTarget& target, const ClampedRect* rects, int count, Color4u color)
+{
+  for(const ClampedRect* rect = rects; rect != rects + count; ++rect)
+    renderFillRectangle(target, rect->_xmin, rect->_ymin, rect->_xmax, rect->_ymax, color);
+}
+
+//
+// Calculates the size of a text string from the metrics of its glyphs.
+//
+static Vector2i measureText(const Font& font, std::string_view text)
+{
+  Vector2i size{0, 0};
+  for(char c : text){
+    if(c == '\n') continue;
+    assert(' ' <= c && c <= '~');
+    const Glyph& glyph = font._glyphs[static_cast<int>(c - ' ')];
+    size._x += glyph._xadvance + font._glyphSpace;
+    size._y = size._y < glyph._height ? glyph._height : size._y;
+  }
+  return size;
+}
+
+//
+// Reserves the buffers of all entries of the text run cache and empties it.
+//
+static void reserveTextRuns()
+{
+  for(auto& textRun : textRuns){
+    textRun._isLive = false;
+    textRun._isPinned = false;
+    textRun._lastUse = 0;
+    textRun._text.reserve(TEXT_RUN_RESERVE_CHARS);
+    textRun._runRows.reserve(TEXT_RUN_RESERVE_ROWS);
+    textRun._runs.reserve(TEXT_RUN_RESERVE_RUNS);
+    textRun._runPixels.reserve(TEXT_RUN_RESERVE_PIXELS);
+    textRun._runIndices.reserve(TEXT_RUN_RESERVE_PIXELS);
+  }
+  textRunScratch.reserve(TEXT_RUN_RESERVE_PIXELS);
+  textRunUseClock = 0;
+  textRunCacheStats = TextRunCacheStats{};
+}
+
+static uint64_t hashTextRunKey(ResourceKey_t fontKey, std::string_view text)
+{
+  uint64_t hash = (FNV_OFFSET_BASIS ^ static_cast<uint64_t>(fontKey)) * FNV_PRIME;
+  for(char c : text)
+    hash = (hash ^ static_cast<uint8_t>(c)) * FNV_PRIME;
+  return hash;
+}
+
+//
+// Composites a text string into runs, overwriting the runs of the entry in place.
+//
+static void bakeTextRun(TextRun& textRun, ResourceKey_t fontKey, const Font& font, std::string_view text, uint64_t hash)
+{
+  textRun._isLive = true;
+  textRun._hash = hash;
+  textRun._fontKey = fontKey;
+  textRun._text.assign(text);
+  textRun._runRows.clear();
+  textRun._runs.clear();
+  textRun._runPixels.clear();
+  textRun._runIndices.clear();
+
+  Vector2i bmin{std::numeric_limits<int>::max(), std::numeric_limits<int>::max()};
+  Vector2i bmax{std::numeric_limits<int>::min(), std::numeric_limits<int>::min()};
+  int penx {0};
+  for(char c : text){
+    if(c == '\n') continue;
+    assert(' ' <= c && c <= '~');
+    const Glyph& glyph = font._glyphs[static_cast<int>(c - ' ')];
+    if(glyph._width > 0 && glyph._height > 0){
+      int x = penx + glyph._xoffset;
+      int y = font._baseLine + glyph._yoffset;
+      bmin._x = std::min(bmin._x, x);
+      bmin._y = std::min(bmin._y, y);
+      bmax._x = std::max(bmax._x, x + glyph._width);
+      bmax._y = std::max(bmax._y, y + glyph._height);
+    }
+    penx += glyph._xadvance + font._glyphSpace;
+  }
+  textRun._textSize = measureText(font, text);
+
+  if(bmin._x > bmax._x){
+    textRun._offset = Vector2i{0, 0};
+    textRun._size = Vector2i{0, 0};
+    textRun._isPalette = font._isPalette;
+    return;
+  }
+
+  textRun._offset = bmin;
+  textRun._size = Vector2i{bmax._x - bmin._x, bmax._y - bmin._y};
+
+  int w = textRun._size._x;
+  int h = textRun._size._y;
+  textRunScratch.assign(w * h, Color4u{ALPHA_KEY, ALPHA_KEY, ALPHA_KEY, ALPHA_KEY});
+  RasterTarget target {textRunScratch.data(), w, 0, 0, w - 1, h - 1, false, nullptr, nullptr, nullptr};
+  compositeText(target, Vector2i{-bmin._x, -bmin._y}, text, font);
+
+  for(int row = 0; row < h; ++row)
+    textRun._runRows.push_back(appendRowRuns(textRunScratch.data() + (row * w), w, textRun._runs, textRun._runPixels));
+  textRun._isPalette = font._isPalette;
+  if(textRun._isPalette)
+    indexRunPixels(textRun._runPixels, textRun._runIndices);
+}
+
+//
+// Finds a text string in the text run cache without baking it on a miss, counting it in the
+// stats or refreshing its use. Returns null on a miss.
+//
+static const TextRun* peekTextRun(ResourceKey_t fontKey, std::string_view text)
+{
+  uint64_t hash = hashTextRunKey(fontKey, text);
+  for(const auto& textRun : textRuns)
+    if(textRun._isLive && textRun._hash == hash && textRun._fontKey == fontKey && textRun._text == text)
+      return &textRun;
+  return nullptr;
+}
+
+//
+// Finds a text string in the text run cache, baking and caching the string on a miss in place
+// of the least recently used unpinned string. If all strings are pinned the deferred draws are
+// rasterised early to unpin them.
+//
+static TextRun& findTextRun(ResourceKey_t fontKey, const Font& font, std::string_view text)
+{
+  uint64_t hash = hashTextRunKey(fontKey, text);
+  for(auto& textRun : textRuns){
+    if(textRun._isLive && textRun._hash == hash && textRun._fontKey == fontKey && textRun._text == text){
+      ++textRunCacheStats._hits;
+      textRun._lastUse = ++textRunUseClock;
+      return textRun;
+    }
+  }
+
+  ++textRunCacheStats._misses;
+
+  TextRun* victim {nullptr};
+  while(victim == nullptr){
+    for(auto& textRun : textRuns){
+      if(textRun._isPinned)
+        continue;
+      if(victim == nullptr || !textRun._isLive || (victim->_isLive && textRun._lastUse < victim->_lastUse))
+        victim = &textRun;
+      if(!victim->_isLive)
+        break;
+    }
+    if(victim == nullptr)
+      rasterDeferredDraws();
+  }
+
+  if(victim->_isLive)
+    ++textRunCacheStats._evictions;
+  else
+    ++textRunCacheStats._entries;
+
+  bakeTextRun(*victim, fontKey, font, text, hash);
+  victim->_lastUse = ++textRunUseClock;
+  return *victim;
+}
+
+//
+// Removes all strings of a font from the text run cache. The deferred draws must have been
+// rasterised.
+//
+static void evictTextRuns(ResourceKey_t fontKey)
+{
+  for(auto& textRun : textRuns){
+    if(textRun._isLive && textRun._fontKey == fontKey){
+      textRun._isLive = false;
+      --textRunCacheStats._entries;
+    }
+  }
+}
+
+static void unpinTextRuns()
+{
+  for(auto& textRun : textRuns)
+    textRun._isPinned = false;
+}
+
+//
+// Appends a command to the draw list of a screen capturing the current shader state of the 
+// screen.
+//
+static DrawCommand& recordCommand(int screenid, DrawCommandType type)
+{
+  const Screen& screen = screens[screenid];
+  DrawCommand& command = drawLists[screenid]._commands.emplace_back();
+  command._type = type;
+  command._shader = screen._xmode == PixelMode::SHADER;
+  command._pxShader = screen._pxShader;
+  command._spanShader = screen._spanShader;
+  return command;
+}
+
+//
+// Executes the draw list of a screen, in order, on the band of rows [ymin, ymax].
+//
+static void rasterTile(const RasterTile& tile)
+{
+  const Screen& screen = screens[tile._screenid];
+  const DrawList& list = drawLists[tile._screenid];
+
+  RasterTarget target = screenTarget(screen);
+  target._ymin = tile._ymin;
+  target._ymax = tile._ymax;
+
+  for(const auto& command : list._commands){
+    target._shader = command._shader;
+    target._pxShader = command._pxShader;
+    target._spanShader = command._spanShader;
+    switch(command._type){
+      case DrawCommandType::CLEAR:
+        renderClear(target, command._color);
+        break;
+      case DrawCommandType::SPRITE:
+        renderRuns(target, spriteRunBlock(*command._sheet, command._spriteid, static_cast<SpriteMirror>(command._arg)),
+                   command._p0._x, command._p0._y);
+        break;
+      case DrawCommandType::SPRITE_COLUMN:
+        renderSpriteColumn(target, *command._sheet, command._spriteid, command._arg, command._p0);
+        break;
+      case DrawCommandType::SPRITE_MASK:
+        renderSpriteMask(target, *command._mask, command._p0, command._color);
+        break;
+      case DrawCommandType::TEXT:
+        renderRuns(target, textRunBlock(*command._textRun), command._p0._x, command._p0._y);
+        break;
+      case DrawCommandType::BORDER_RECTANGLE:
+        renderBorderRectangle(target, command._p0._x, command._p0._y, command._p1._x, command._p1._y, command._color);
+        break;
+      case DrawCommandType::FILL_RECTANGLE:
+        renderFillRectangle(target, command._p0._x, command._p0._y, command._p1._x, command._p1._y, command._color);
+        break;
+      case DrawCommandType::FILL_RECTANGLES:
+        renderFillRectangles(target, list._rects.data() + command._arg, command._count, command._color);
+        break;
+      case DrawCommandType::LINE:
+        renderLine(target, command._p0, command._p1, command._color);
+        break;
+      case DrawCommandType::LINES:
+        renderLines(target, list._points.data() + command._arg, command._count, command._color);
+        break;
+      case DrawCommandType::POINT:
+        renderPoint(target, command._p0, command._color);
+        break;
+    }
+  }
+}
+
+//
+// Runs 'job' on all pending tiles, sharing the tiles between up to rasterThreadCount job 
+// workers. Returns once all tiles are done.
+//
+static void runRasterTiles(RasterTileJob_t job)
+{
+  if(pendingRasterTiles.empty())
+    return;
+
+  jobs::parallelFor(0, static_cast<int>(pendingRasterTiles.size()), 1, [job](int begin, int end){
+    PXR_PROFILE_SCOPE("gfx::rasterTiles");
+    for(int tileid = begin; tileid < end; ++tileid)
+      job(pendingRasterTiles[tileid]);
+  }, rasterThreadCount);
+}
+
+//
+// The height of the tiles a region of 'height' rows is split into.
+//
+static int getRasterTileHeight(int height)
+{
+  return std::max(MIN_RASTER_TILE_HEIGHT, height / (rasterThreadCount * RASTER_TILES_PER_THREAD));
+}
+
+//
+// Rasterises the draw lists of all deferred screens, splitting each screen into tiles shared
+// between the raster threads, then clears the lists.
+//
+static void rasterDeferredDraws()
+{
+  pendingRasterTiles.clear();
+  for(int screenid = 0; screenid < screens.size(); ++screenid){
+    if(drawLists[screenid]._commands.empty())
+      continue;
+    int height = screens[screenid]._resolution._y;
+    int tileHeight = getRasterTileHeight(height);
+    for(int ymin = 0; ymin < height; ymin += tileHeight)
+      pendingRasterTiles.push_back(RasterTile{screenid, ymin, std::min(ymin + tileHeight, height) - 1});
+  }
+
+  if(!pendingRasterTiles.empty()){
+    runRasterTiles(rasterTile);
+
+    for(auto& list : drawLists){
+      list._commands.clear();
+      list._rects.clear();
+      list._points.clear();
+    }
+  }
+
+  unpinTextRuns();
+}
+
+void setRasterThreadCount(int count)
+{
+  rasterThreadCount = std::clamp(count, 1, MAX_RASTER_THREADS);
+  log::log(log::INFO, log::msg_gfx_raster_threads, std::to_string(rasterThreadCount));
+}
+
+int getRasterThreadCount()
+{
+  return rasterThreadCount;
+}
+
+//
+// The draw calls proper. The public draw calls which take colors check the screen accepts 
+// colors (see isDrawableOn) before submitting; those which take palette indices submit the
+// index as its default color (see toPaletteIndex).
+//
+static void submitClear(Color4u color, int screenid)
+{
+  assert(0 <= screenid && screenid < screens.size());
+  Screen& screen = screens[screenid];
+
+  markAllDirty(screen);
+
+  if(screen._dmode == DrawMode::DEFERRED){
+    //
+    // A clear overwrites all prior draws so they can be dropped.
+    //
+    drawLists[screenid]._commands.clear();
+    drawLists[screenid]._rects.clear();
+    drawLists[screenid]._points.clear();
+    recordCommand(screenid, DrawCommandType::CLEAR)._color = color;
+    return;
+  }
+
+  renderClear(screenTarget(screen), color);
+}
+
+void drawSprite(Vector2i position, ResourceKey_t sheetKey, int spriteid, int screenid, 
+                bool mirrorX, bool mirrorY)
+{
+  assert(0 <= screenid && screenid < screens.size());
+  auto& screen = screens[screenid];
+
+  const auto& sheet = spritesheets[sheetKey]._sheet;
+
+  assert(0 <= spriteid);
+
+  if(sheetKey == errorSpritesheetKey)
+    spriteid = (spriteid < sheet._sprites.size()) ? spriteid : 0;
+  else
+    assert(spriteid < sheet._sprites.size());
+
+  auto& sprite = sheet._sprites[spriteid];
+
+  if(!isDrawableOn(screen, sheet._isPalette))
+    return;
+
+  int screenColBase = position._x - sprite._origin._x;
+  int screenRowBase = position._y - sprite._origin._y;
+
+  BlockClip clip;
+  if(!clipBlock(screenTarget(screen), screenColBase, screenRowBase, sprite._size._x, sprite._size._y, clip))
+    return;
+
+  markDirty(screen, screenColBase + clip._colBegin, screenRowBase + clip._rowBegin,
+                    screenColBase + clip._colEnd - 1, screenRowBase + clip._rowEnd - 1);
+
+  SpriteMirror mirror = mirrorX ? (mirrorY ? MIRROR_XY : MIRROR_X) : (mirrorY ? MIRROR_Y : MIRROR_NONE);
+
+  if(screen._dmode == DrawMode::DEFERRED){
+    DrawCommand& command = recordCommand(screenid, DrawCommandType::SPRITE);
+    command._sheet = &sheet;
+    command._spriteid = spriteid;
+    command._arg = mirror;
+    command._p0 = Vector2i{screenColBase, screenRowBase};
+    return;
+  }
+
+  renderRuns(screenTarget(screen), spriteRunBlock(sheet, spriteid, mirror), screenColBase, screenRowBase);
+}
+
+void drawSpriteColumn(Vector2i position, ResourceKey_t sheetKey, int spriteid, int colid, int screenid)
+{
+  assert(0 <= screenid && screenid < screens.size());
+  auto& screen = screens[screenid];
+
+  const auto& sheet = spritesheets[sheetKey]._sheet;
+
+  assert(0 <= spriteid);
+  spriteid = spriteid < sheet._sprites.size() ? spriteid : 0; // may be an error sheet with 1 sprite.
+  auto& sprite = sheet._sprites[spriteid];
+
+  colid = std::clamp(colid, 0, sprite._size._x - 1);
+
+  if(!isDrawableOn(screen, sheet._isPalette))
+    return;
+
+  int screenCol = position._x + colid;
+
+  BlockClip clip;
+  if(!clipBlock(screenTarget(screen), screenCol, position._y, 1, sprite._size._y, clip))
+    return;
+
+  markDirty(screen, screenCol, position._y + clip._rowBegin, screenCol, position._y + clip._rowEnd - 1);
+
+  if(screen._dmode == DrawMode::DEFERRED){
+    DrawCommand& command = recordCommand(screenid, DrawCommandType::SPRITE_COLUMN);
+    command._sheet = &sheet;
+    command._spriteid = spriteid;
+    command._arg = colid;
+    command._p0 = position;
+    return;
+  }
+
+  renderSpriteColumn(screenTarget(screen), sheet, spriteid, colid, position);
+}
+
+static void submitSpriteMask(Vector2i position, ResourceKey_t maskKey, Color4u tint, int screenid)
+{
+  assert(0 <= screenid && screenid < screens.size());
+  auto& screen = screens[screenid];
+
+  const auto& mask = spriteMasks[maskKey]._mask;
+
+  BlockClip clip;
+  if(!clipBlock(screenTarget(screen), position._x, position._y, mask._size._x, mask._size._y, clip))
+    return;
+
+  markDirty(screen, position._x + clip._colBegin, position._y + clip._rowBegin,
+                    position._x + clip._colEnd - 1, position._y + clip._rowEnd - 1);
+
+  if(screen._dmode == DrawMode::DEFERRED){
+    DrawCommand& command = recordCommand(screenid, DrawCommandType::SPRITE_MASK);
+    command._mask = &mask;
+    command._color = tint;
+    command._p0 = position;
+    return;
+  }
+
+  renderSpriteMask(screenTarget(screen), mask, position, tint);
+}
+
+void drawText(Vector2i position, std::string_view text, ResourceKey_t fontKey, int screenid)
+{
+  assert(0 <= screenid && screenid < screens.size());
+  auto& screen = screens[screenid];
+
+  auto& font = fonts[fontKey]._font;
+
+  TextRun& textRun = findTextRun(fontKey, font, text);
+
+  if(!isDrawableOn(screen, textRun._isPalette))
+    return;
+
+  int screenColBase = position._x + textRun._offset._x;
+  int screenRowBase = position._y + textRun._offset._y;
+
+  BlockClip clip;
+  if(!clipBlock(screenTarget(screen), screenColBase, screenRowBase, textRun._size._x, textRun._size._y, clip))
+    return;
+
+  markDirty(screen, screenColBase + clip._colBegin, screenRowBase + clip._rowBegin,
+                    screenColBase + clip._colEnd - 1, screenRowBase + clip._rowEnd - 1);
+
+  if(screen._dmode == DrawMode::DEFERRED){
+    DrawCommand& command = recordCommand(screenid, DrawCommandType::TEXT);
+    command._textRun = &textRun;
+    command._p0 = Vector2i{screenColBase, screenRowBase};
+    textRun._isPinned = true;
+    return;
+  }
+
+  renderRuns(screenTarget(screen), textRunBlock(textRun), screenColBase, screenRowBase);
+}
+
+static void submitBorderRectangle(iRect rect, Color4u color, int screenid)
+{
+  assert(0 <= screenid && screenid < screens.size());
+  auto& screen = screens[screenid];
+
+  int xmin = std::clamp(rect._x,           0, screen._resolution._x - 1);
+  int xmax = std::clamp(rect._x + rect._w, 0, screen._resolution._x - 1);
+  int ymin = std::clamp(rect._y,           0, screen._resolution._y - 1);
+  int ymax = std::clamp(rect._y + rect._h, 0, screen._resolution._y - 1);
+  markDirty(screen, xmin, ymin, xmax, ymax);
+
+  if(screen._dmode == DrawMode::DEFERRED){
+    DrawCommand& command = recordCommand(screenid, DrawCommandType::BORDER_RECTANGLE);
+    command._color = color;
+    command._p0 = Vector2i{xmin, ymin};
+    command._p1 = Vector2i{xmax, ymax};
+    return;
+  }
+
+  renderBorderRectangle(screenTarget(screen), xmin, ymin, xmax, ymax, color);
+}
+
+static ClampedRect clampRect(const Screen& screen, iRect rect)
+{
+  ClampedRect clamped;
+  clamped._xmin = std::clamp(rect._x,           0, screen._resolution._x - 1);
+  clamped._xmax = std::clamp(rect._x + rect._w, 0, screen._resolution._x - 1);
+  clamped._ymin = std::clamp(rect._y,           0, screen._resolution._y - 1);
+  clamped._ymax = std::clamp(rect._y + rect._h, 0, screen._resolution._y - 1);
+  return clamped;
+}
+
+static void submitFillRectangle(iRect rect, Color4u color, int screenid)
+{
+  assert(0 <= screenid && screenid < screens.size());
+  auto& screen = screens[screenid];
+
+  ClampedRect clamped = clampRect(screen, rect);
+  markDirty(screen, clamped._xmin, clamped._ymin, clamped._xmax, clamped._ymax);
+
+  if(screen._dmode == DrawMode::DEFERRED){
+    DrawCommand& command = recordCommand(screenid, DrawCommandType::FILL_RECTANGLE);
+    command._color = color;
+    command._p0 = Vector2i{clamped._xmin, clamped._ymin};
+    command._p1 = Vector2i{clamped._xmax, clamped._ymax};
+    return;
+  }
+
+  renderFillRectangle(screenTarget(screen), clamped._xmin, clamped._ymin, clamped._xmax, clamped._ymax, color);
+}
+
+static void submitFillRectangles(const iRect* rects, int count, Color4u color, int screenid)
+{
+  assert(0 <= screenid && screenid < screens.size());
+  assert(rects != nullptr || count == 0);
+  auto& screen = screens[screenid];
+
+  if(count <= 0)
+    return;
+
+  if(screen._dmode == DrawMode::DEFERRED){
+    DrawList& list = drawLists[screenid];
+    DrawCommand& command = recordCommand(screenid, DrawCommandType::FILL_RECTANGLES);
+    command._color = color;
+    command._arg = list._rects.size();
+    command._count = count;
+    for(int i = 0; i < count; ++i){
+      const ClampedRect& clamped = list._rects.emplace_back(clampRect(screen, rects[i]));
+      markDirty(screen, clamped._xmin, clamped._ymin, clamped._xmax, clamped._ymax);
+    }
+    return;
+  }
+
+  RasterTarget target = screenTarget(screen);
+  for(int i = 0; i < count; ++i){
+    ClampedRect clamped = clampRect(screen, rects[i]);
+    markDirty(screen, clamped._xmin, clamped._ymin, clamped._xmax, clamped._ymax);
+    renderFillRectangles(target, &clamped, 1, color);
+  }
+}
+
+//
+// Cohen-Sutherland outcodes of a point w.r.t the bounds of a screen.
+//
+enum OutCode
+{
+  OUT_INSIDE = 0,
+  OUT_XMIN   = 1 << 0,
+  OUT_XMAX   = 1 << 1,
+  OUT_YMIN   = 1 << 2,
+  OUT_YMAX   = 1 << 3
+};
+
+static int outCode(Vector2i p, int xmax, int ymax)
+{
+  int code = OUT_INSIDE;
+  if(p._x < 0) code |= OUT_XMIN;
+  else if(p._x > xmax) code |= OUT_XMAX;
+  if(p._y < 0) code |= OUT_YMIN;
+  else if(p._y > ymax) code |= OUT_YMAX;
+  return code;
+}
+
+//
+// Clips a line to a screen with Cohen-Sutherland. Returns false if no part of the line is on
+// the screen. Clipped end points are interpolated along the original line (not the partially
+// clipped line) so rounding errors do not accumulate over clips.
+//
+static bool clipLine(const Screen& screen, Vector2i& p0, Vector2i& p1)
+{
+  static constexpr int MAX_CLIPS {4};  // one per edge.
+
+  int xmax = screen._resolution._x - 1;
+  int ymax = screen._resolution._y - 1;
+
+  const Vector2i a0 {p0};
+  const Vector2i a1 {p1};
+  double dx = a1._x - a0._x;
+  double dy = a1._y - a0._y;
+
+  auto xAt = [&](int y){return a0._x + static_cast<int>(std::lround(dx * (y - a0._y) / dy));};
+  auto yAt = [&](int x){return a0._y + static_cast<int>(std::lround(dy * (x - a0._x) / dx));};
+
+  int code0 = outCode(p0, xmax, ymax);
+  int code1 = outCode(p1, xmax, ymax);
+  for(int clip = 0; clip <= MAX_CLIPS; ++clip){
+    if((code0 | code1) == OUT_INSIDE)
+      return true;
+    if((code0 & code1) != OUT_INSIDE)
+      return false;
+
+    bool isClippingP0 = code0 != OUT_INSIDE;
+    int code = isClippingP0 ? code0 : code1;
+    Vector2i p;
+    if(code & OUT_YMAX)      p = Vector2i{xAt(ymax), ymax};
+    else if(code & OUT_YMIN) p = Vector2i{xAt(0), 0};
+    else if(code & OUT_XMAX) p = Vector2i{xmax, yAt(xmax)};
+    else                     p = Vector2i{0, yAt(0)};
+
+    if(isClippingP0){
+      p0 = p;
+      code0 = outCode(p0, xmax, ymax);
+    }
+    else{
+      p1 = p;
+      code1 = outCode(p1, xmax, ymax);
+    }
+  }
+
+  return false;  // the line only grazes a corner of the screen.
+}
+
+static void submitLine(Vector2i p0, Vector2i p1, Color4u color, int screenid)
+{
+  assert(0 <= screenid && screenid < screens.size());
+  auto& screen = screens[screenid];
+
+  if(!clipLine(screen, p0, p1))
+    return;
+
+  markDirty(screen, std::min(p0._x, p1._x), std::min(p0._y, p1._y), 
+                    std::max(p0._x, p1._x), std::max(p0._y, p1._y));
+
+  if(screen._dmode == DrawMode::DEFERRED){
+    DrawCommand& command = recordCommand(screenid, DrawCommandType::LINE);
+    command._color = color;
+    command._p0 = p0;
+    command._p1 = p1;
+    return;
+  }
+
+  renderLine(screenTarget(screen), p0, p1, color);
+}
+
+//
+// Draws the lines between consecutive pairs of points in 'points', i.e. [p0, p1], [p1, p2]...
+// if 'stride' is 1 (a polyline) or [p0, p1], [p2, p3]... if 'stride' is 2.
+//
+static void drawLineBatch(const Vector2i* points, int lineCount, int stride, Color4u color, int screenid)
+{
+  assert(0 <= screenid && screenid < screens.size());
+  auto& screen = screens[screenid];
+
+  DrawList* list {nullptr};
+  DrawCommand* command {nullptr};
+  if(screen._dmode == DrawMode::DEFERRED){
+    list = &drawLists[screenid];
+    command = &recordCommand(screenid, DrawCommandType::LINES);
+    command->_color = color;
+    command->_arg = list->_points.size();
+    command->_count = 0;
+  }
+
+  RasterTarget target = screenTarget(screen);
+  for(int i = 0; i < lineCount; ++i){
+    Vector2i p0 = points[i * stride];
+    Vector2i p1 = points[(i * stride) + 1];
+    if(!clipLine(screen, p0, p1))
+      continue;
+
+    markDirty(screen, std::min(p0._x, p1._x), std::min(p0._y, p1._y), 
+                      std::max(p0._x, p1._x), std::max(p0._y, p1._y));
+
+    if(command != nullptr){
+      list->_points.push_back(p0);
+      list->_points.push_back(p1);
+      ++command->_count;
+      continue;
+    }
+
+    renderLine(target, p0, p1, color);
+  }
+}
+
+static void submitLines(const Vector2i* endPoints, int lineCount, Color4u color, int screenid)
+{
+  assert(endPoints != nullptr || lineCount == 0);
+  if(lineCount > 0)
+    drawLineBatch(endPoints, lineCount, 2, color, screenid);
+}
+
+static void submitPolyline(const Vector2i* points, int pointCount, Color4u color, int screenid, bool isClosed)
+{
+  assert(points != nullptr || pointCount == 0);
+  if(pointCount < 2)
+    return;
+
+  drawLineBatch(points, pointCount - 1, 1, color, screenid);
+  if(isClosed && pointCount > 2){
+    Vector2i closingLine[2] {points[pointCount - 1], points[0]};
+    drawLineBatch(closingLine, 1, 2, color, screenid);
+  }
+}
+
+static void submitPoint(Vector2i position, Color4u color, int screenid)
+{
+  assert(0 <= screenid && screenid < screens.size());
+  auto& screen = screens[screenid];
+
+  int x{position._x}, y{position._y};
+
+  if(x < 0 || x >= screen._resolution._x)
+    return;
+
+  if(y < 0 || y >= screen._resolution._y)
+    return;
+
+  markDirty(screen, x, y, x, y);
+
+  if(screen._dmode == DrawMode::DEFERRED){
+    DrawCommand& command = recordCommand(screenid, DrawCommandType::POINT);
+    command._color = color;
+    command._p0 = position;
+    return;
+  }
+
+  renderPoint(screenTarget(screen), position, color);
+}
+
+static bool isColorDrawableOn(int screenid)
+{
+  assert(0 <= screenid && screenid < screens.size());
+  return isDrawableOn(screens[screenid], false);
+}
+
+void clearScreenTransparent(int screenid)
+{
+  submitClear(Color4u{ALPHA_KEY, ALPHA_KEY, ALPHA_KEY, ALPHA_KEY}, screenid);
+}
+
+void clearScreenShade(int shade, int screenid)
+{
+  shade = std::max(0, std::min(shade, 255));
+  auto s = static_cast<uint8_t>(shade);
+  clearScreenColor(Color4u{s, s, s, s}, screenid);
+}
+
+void clearScreenColor(Color4u color, int screenid)
+{
+  if(isColorDrawableOn(screenid))
+    submitClear(color, screenid);
+}
+
+void drawSpriteMask(Vector2i position, ResourceKey_t maskKey, Color4u tint, int screenid)
+{
+  if(isColorDrawableOn(screenid))
+    submitSpriteMask(position, maskKey, tint, screenid);
+}
+
+void drawBorderRectangle(iRect rect, Color4u color, int screenid)
+{
+  if(isColorDrawableOn(screenid))
+    submitBorderRectangle(rect, color, screenid);
+}
+
+void drawFillRectangle(iRect rect, Color4u color, int screenid)
+{
+  if(isColorDrawableOn(screenid))
+    submitFillRectangle(rect, color, screenid);
+}
+
+void drawFillRectangles(const iRect* rects, int count, Color4u color, int screenid)
+{
+  if(isColorDrawableOn(screenid))
+    submitFillRectangles(rects, count, color, screenid);
+}
+
+void drawLine(Vector2i p0, Vector2i p1, Color4u color, int screenid)
+{
+  if(isColorDrawableOn(screenid))
+    submitLine(p0, p1, color, screenid);
+}
+
+void drawLines(const Vector2i* endPoints, int lineCount, Color4u color, int screenid)
+{
+  if(isColorDrawableOn(screenid))
+    submitLines(endPoints, lineCount, color, screenid);
+}
+
+void drawPolyline(const Vector2i* points, int pointCount, Color4u color, int screenid, bool isClosed)
+{
+  if(isColorDrawableOn(screenid))
+    submitPolyline(points, pointCount, color, screenid, isClosed);
+}
+
+void drawPoint(Vector2i position, Color4u color, int screenid)
+{
+  if(isColorDrawableOn(screenid))
+    submitPoint(position, color, screenid);
+}
+
+void clearScreenColor(PaletteIndex_t index, int screenid)
+{
+  submitClear(paletteColor(index), screenid);
+}
+
+void drawSpriteMask(Vector2i position, ResourceKey_t maskKey, PaletteIndex_t tint, int screenid)
+{
+  submitSpriteMask(position, maskKey, paletteColor(tint), screenid);
+}
+
+void drawBorderRectangle(iRect rect, PaletteIndex_t index, int screenid)
+{
+  submitBorderRectangle(rect, paletteColor(index), screenid);
+}
+
+void drawFillRectangle(iRect rect, PaletteIndex_t index, int screenid)
+{
+  submitFillRectangle(rect, paletteColor(index), screenid);
+}
+
+void drawFillRectangles(const iRect* rects, int count, PaletteIndex_t index, int screenid)
+{
+  submitFillRectangles(rects, count, paletteColor(index), screenid);
+}
+
+void drawLine(Vector2i p0, Vector2i p1, PaletteIndex_t index, int screenid)
+{
+  submitLine(p0, p1, paletteColor(index), screenid);
+}
+
+void drawLines(const Vector2i* endPoints, int lineCount, PaletteIndex_t index, int screenid)
+{
+  submitLines(endPoints, lineCount, paletteColor(index), screenid);
+}
+
+void drawPolyline(const Vector2i* points, int pointCount, PaletteIndex_t index, int screenid, bool isClosed)
+{
+  submitPolyline(points, pointCount, paletteColor(index), screenid, isClosed);
+}
+
+void drawPoint(Vector2i position, PaletteIndex_t index, int screenid)
+{
+  submitPoint(position, paletteColor(index), screenid);
+}
+
+//
+// Returns the colors of all pixels of a screen. The colors of PALETTE8 screens are looked up
+// in the screen's palette, so this costs a lookup per pixel; only used where every pixel is
+// processed anyway.
+//
+static const Color4u* resolveScreenColors(const Screen& screen)
+{
+  if(screen._cmode != ColorMode::PALETTE8)
+    return screen._pxColors;
+  blitRowPalette(resolvedColors.data(), screen._pxIndices, screen._palette.data(), screen._pxCount);
+  return resolvedColors.data();
+}
+
+static void presentPoints(const Screen& screen)
+{
+  glVertexPointer(2, GL_INT, 0, screen._pxPositions);
+  glColorPointer(4, GL_UNSIGNED_BYTE, 0, resolveScreenColors(screen));
+  glPointSize(screen._pxSize);
+  glDrawArrays(GL_POINTS, 0, screen._pxCount);
+}
+
+//
+// Streams the region [xmin, xmin + w) x [ymin, ymin + h) of 'pixels' (of 'pitch' pixels per 
+// row) into the same region of a texture; the rows of the region are packed tightly into the 
+// pbo. The pbos are alternated between uploads so writing this frame's pixels need not wait on
+// the driver finishing with last frame's. The buffer store is orphaned before mapping for the
+// same reason. Pixels are colors for rgba textures and palette indices for single channel
+// textures.
+//
+// Returns false if the pbo could not be mapped, in which case nothing is uploaded and the
+// caller must upload the region again later.
+//
+template<typename Pixel>
+static bool uploadTexture(unsigned texture, const unsigned* pbos, int& pboIndex, int pboBytes, 
+                         const Pixel* pixels, int pitch, int xmin, int ymin, int w, int h)
+{
+  constexpr GLenum format = std::is_same_v<Pixel, PaletteIndex_t> ? GL_LUMINANCE : GL_RGBA;
+
+  pboIndex = (pboIndex + 1) % PBO_COUNT;
+  pglBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbos[pboIndex]);
+  pglBufferData(GL_PIXEL_UNPACK_BUFFER, pboBytes, nullptr, GL_STREAM_DRAW);
+  auto* pbo = static_cast<Pixel*>(pglMapBuffer(GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY));
+  if(pbo == nullptr){
+    pglBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    return false;
+  }
+
+  const Pixel* src = pixels + xmin + (ymin * pitch);
+  if(w == pitch)
+    memcpy(static_cast<void*>(pbo), static_cast<const void*>(src), w * h * sizeof(Pixel));
+  else{
+    for(int row = 0; row < h; ++row){
+      memcpy(static_cast<void*>(pbo), static_cast<const void*>(src), w * sizeof(Pixel));
+      pbo += w;
+      src += pitch;
+    }
+  }
+
+  pglUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+  glBindTexture(GL_TEXTURE_2D, texture);
+  glTexSubImage2D(GL_TEXTURE_2D, 0, xmin, ymin, w, h, format, GL_UNSIGNED_BYTE, nullptr);
+  pglBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+  return true;
+}
+
+//
+// Streams the dirty region of a screen's pixels (its indices if PALETTE8) into its texture, 
+// then clears the region. If the upload fails the region remains dirty so is uploaded next 
+// frame.
+//
+static void uploadScreenTexture(Screen& screen)
+{
+  if(!screen._isDirty)
+    return;
+
+  int xmin = screen._dirtyMin._x;
+  int ymin = screen._dirtyMin._y;
+  int w = screen._dirtyMax._x - xmin + 1;
+  int h = screen._dirtyMax._y - ymin + 1;
+
+  bool isUploaded = (screen._cmode == ColorMode::PALETTE8) ?
+    uploadTexture(screen._glTexture, screen._glPbos, screen._pboIndex, screen._pxCount * sizeof(PaletteIndex_t),
+                  screen._pxIndices, screen._resolution._x, xmin, ymin, w, h) :
+    uploadTexture(screen._glTexture, screen._glPbos, screen._pboIndex, screen._pxCount * sizeof(Color4u),
+                  screen._pxColors, screen._resolution._x, xmin, ymin, w, h);
+  if(!isUploaded)
+    return;
+
+  ++presentStats._screensUploaded;
+  presentStats._pxUploaded += w * h;
+  screen._isDirty = false;
+}
+
+//
+// Uploads the palette of a PALETTE8 screen if it changed since last uploaded. Palettes are
+// small enough to upload directly rather than via the pbos.
+//
+static void uploadScreenPalette(Screen& screen)
+{
+  if(!screen._isPaletteStale)
+    return;
+
+  glBindTexture(GL_TEXTURE_2D, screen._glPaletteTexture);
+  glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, PALETTE_SIZE, 1, GL_RGBA, GL_UNSIGNED_BYTE, screen._palette.data());
+  screen._isPaletteStale = false;
+}
+
+static void drawTexturedQuad(unsigned texture, int x0, int y0, int x1, int y1)
+{
+  glBindTexture(GL_TEXTURE_2D, texture);
+  glBegin(GL_QUADS);
+    glTexCoord2f(0.f, 0.f); glVertex2i(x0, y0);
+    glTexCoord2f(1.f, 0.f); glVertex2i(x1, y0);
+    glTexCoord2f(1.f, 1.f); glVertex2i(x1, y1);
+    glTexCoord2f(0.f, 1.f); glVertex2i(x0, y1);
+  glEnd();
+}
+
+static void presentTexture(Screen& screen)
+{
+  uploadScreenTexture(screen);
+
+  int x0 = screen._position._x;
+  int y0 = screen._position._y;
+  int x1 = x0 + (screen._resolution._x * screen._pxSize);
+  int y1 = y0 + (screen._resolution._y * screen._pxSize);
+
+  if(screen._cmode != ColorMode::PALETTE8){
+    drawTexturedQuad(screen._glTexture, x0, y0, x1, y1);
+    return;
+  }
+
+  uploadScreenPalette(screen);
+  pglActiveTexture(GL_TEXTURE0 + PALETTE_COLORS_TEXTURE_UNIT);
+  glBindTexture(GL_TEXTURE_2D, screen._glPaletteTexture);
+  pglActiveTexture(GL_TEXTURE0 + PALETTE_INDICES_TEXTURE_UNIT);
+  pglUseProgram(paletteProgram);
+  drawTexturedQuad(screen._glTexture, x0, y0, x1, y1);
+  pglUseProgram(0);
+}
+
+//
+// Accumulates pixels into a 64-bit FNV-1a hash, hashing a whole pixel at a time.
+//
+static uint64_t checksumPixels(const Color4u* px, int count, uint64_t hash)
+{
+  for(int i = 0; i < count; ++i){
+    uint32_t value;
+    memcpy(&value, &px[i], sizeof(value));
+    hash = (hash ^ value) * FNV_PRIME;
+  }
+  return hash;
+}
+
+//
+// Returns the row of a screen shown on row 'y' of the window or -1 if the screen does not
+// cover the row.
+//
+static int getScreenRowAt(const Screen& screen, int y)
+{
+  int offset = y - screen._position._y;
+  if(offset < 0)
+    return -1;
+  int row = offset / screen._pxSize;
+  return row < screen._resolution._y ? row : -1;
+}
+
+//
+// Returns true if row 'y' of the composite is a copy of row 'y - 1', i.e. every enabled
+// screen shows the same row (or no row) on both.
+//
+static bool isCompositeRowRepeated(int y)
+{
+  for(const auto& screen : screens)
+    if(screen._isEnabled && getScreenRowAt(screen, y) != getScreenRowAt(screen, y - 1))
+      return false;
+  return true;
+}
+
+static inline Color4u lookupColor(const Screen& screen, Color4u pixel)
+{
+  return pixel;
+}
+
+static inline Color4u lookupColor(const Screen& screen, PaletteIndex_t pixel)
+{
+  return screen._palette[pixel];
+}
+
+//
+// Scales a row of a screen by its pixel size onto a row of the composite, skipping pixels
+// with the alpha key. The pixels of PALETTE8 screens are looked up in the screen's palette, 
+// whose key entry has the alpha key.
+//
+template<typename Pixel>
+static void compositeScreenRow(const Screen& screen, const Pixel* src, Color4u* dst)
+{
+  int pxSize = screen._pxSize;
+  int x0 = screen._position._x;
+
+  int colBegin = std::max(0, -x0 / pxSize);
+  int colEnd = std::min(screen._resolution._x, (compositeSize._x - x0 + pxSize - 1) / pxSize);
+  if(colBegin >= colEnd)
+    return;
+
+  if constexpr(std::is_same_v<Pixel, Color4u>){
+    if(pxSize == 1){
+      int xbegin = std::max(x0 + colBegin, 0);
+      int xend = std::min(x0 + colEnd, compositeSize._x);
+      blitRowKeyed(dst + xbegin, src + (xbegin - x0), xend - xbegin);
+      return;
+    }
+  }
+
+  for(int col = colBegin; col < colEnd; ++col){
+    Color4u color = lookupColor(screen, src[col]);
+    if(color._a == ALPHA_KEY)
+      continue;
+    int xbegin = std::max(x0 + (col * pxSize), 0);
+    int xend = std::min(x0 + ((col + 1) * pxSize), compositeSize._x);
+    std::fill(dst + xbegin, dst + xend, color);
+  }
+}
+
+//
+// Composites the rows [_ymin, _ymax] of the composite. Rows which repeat the row below (i.e.
+// the 2nd and later rows of scaled pixels) are copied rather than recomposited.
+//
+static void compositeTile(const RasterTile& tile)
+{
+  int w = compositeSize._x;
+  for(int y = tile._ymin; y <= tile._ymax; ++y){
+    Color4u* dst = compositeColors.data() + (y * w);
+    if(y != tile._ymin && isCompositeRowRepeated(y)){
+      memcpy(static_cast<void*>(dst), static_cast<const void*>(dst - w), w * sizeof(Color4u));
+      continue;
+    }
+    blitRowFill(dst, Color4u{ALPHA_KEY, ALPHA_KEY, ALPHA_KEY, ALPHA_KEY}, w);
+    for(const auto& screen : screens){
+      if(!screen._isEnabled)
+        continue;
+      int row = getScreenRowAt(screen, y);
+      if(row == -1)
+        continue;
+      if(screen._cmode == ColorMode::PALETTE8)
+        compositeScreenRow(screen, screen._pxIndices + (row * screen._resolution._x), dst);
+      else
+        compositeScreenRow(screen, screen._pxColors + (row * screen._resolution._x), dst);
+    }
+  }
+}
+
+//
+// Records the layout of all screens. Returns true if the layout changed since the last call.
+//
+static bool updateCompositeLayers()
+{
+  bool isChanged = compositeLayers.size() != screens.size();
+  compositeLayers.resize(screens.size());
+  for(int i = 0; i < screens.size(); ++i){
+    const Screen& screen = screens[i];
+    CompositeLayer& layer = compositeLayers[i];
+    if(layer._isEnabled != screen._isEnabled || !(layer._position == screen._position) || layer._pxSize != screen._pxSize){
+      layer = CompositeLayer{screen._isEnabled, screen._position, screen._pxSize};
+      isChanged = true;
+    }
+  }
+  return isChanged;
+}
+
+//
+// Rebuilds the composite if any screen changed, sharing its rows between the raster threads,
+// then presents it as a single window sized quad.
+//
+static void presentComposite(bool isAnyScreenDirty)
+{
+  bool isLayoutChanged = updateCompositeLayers();
+  if(isCompositeStale || isLayoutChanged || isAnyScreenDirty){
+    pendingRasterTiles.clear();
+    int tileHeight = getRasterTileHeight(compositeSize._y);
+    for(int ymin = 0; ymin < compositeSize._y; ymin += tileHeight)
+      pendingRasterTiles.push_back(RasterTile{0, ymin, std::min(ymin + tileHeight, compositeSize._y) - 1});
+    runRasterTiles(compositeTile);
+    isCompositeStale = false;
+
+    //
+    // A failed upload leaves the composite stale so it is uploaded again next frame.
+    //
+    if(backend == Backend::OPENGL){
+      if(uploadTexture(compositeTexture, compositePbos, compositePboIndex, compositeColors.size() * sizeof(Color4u), 
+                       compositeColors.data(), compositeSize._x, 0, 0, compositeSize._x, compositeSize._y)){
+        presentStats._pxUploaded += compositeColors.size();
+        ++presentStats._screensUploaded;
+      }
+      else
+        isCompositeStale = true;
+    }
+  }
+
+  if(backend == Backend::HEADLESS)
+    presentStats._checksum = checksumPixels(compositeColors.data(), compositeColors.size(), presentStats._checksum);
+  else
+    drawTexturedQuad(compositeTexture, 0, 0, compositeSize._x, compositeSize._y);
+}
+
+void present()
+{
+  PXR_PROFILE_SCOPE("gfx::present");
+
+  auto presentStart = std::chrono::steady_clock::now();
+
+  rasterDeferredDraws();
+
+  presentStats = PresentStats{};
+  presentStats._checksum = FNV_OFFSET_BASIS;
+
+  bool isAnyScreenDirty {false};
+  for(auto& screen : screens){
+    if(!screen._isEnabled)
+      continue;
+
+    ++presentStats._screensPresented;
+    presentStats._pxPresented += screen._pxCount;
+    presentStats._pxDirty += getDirtyPixelCount(screen);
+
+    //
+    // Composited screens are presented together below. Headless screens are only checksummed.
+    // Points are resubmitted every frame regardless of dirty state since the window is cleared
+    // between frames. Textured screens clear their dirty region only once it is uploaded.
+    //
+    if(presentMode == PresentMode::COMPOSITE)
+      isAnyScreenDirty |= screen._isDirty;
+    else if(backend == Backend::HEADLESS)
+      presentStats._checksum = checksumPixels(resolveScreenColors(screen), screen._pxCount, presentStats._checksum);
+    else if(presentMode == PresentMode::TEXTURE){
+      presentTexture(screen);
+      continue;
+    }
+    else{
+      presentPoints(screen);
+      ++presentStats._screensUploaded;
+      presentStats._pxUploaded += screen._pxCount;
+    }
+
+    screen._isDirty = false;
+  }
+
+  if(presentMode == PresentMode::COMPOSITE)
+    presentComposite(isAnyScreenDirty);
+
+  if(backend == Backend::OPENGL)
+    SDL_GL_SwapWindow(window);
+
+  presentStats._presentNanos = std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now() - presentStart
+  ).count();
+}
+
+const PresentStats& getPresentStats()
+{
+  return presentStats;
+}
+
+void setScreenPixelMode(PixelMode mode, int screenid)
+{
+  assert(0 <= screenid && screenid < screens.size());
+  screens[screenid]._xmode = mode;
+}
+
+void setScreenDrawMode(DrawMode mode, int screenid)
+{
+  assert(0 <= screenid && screenid < screens.size());
+  if(mode == DrawMode::IMMEDIATE)
+    rasterDeferredDraws();
+  screens[screenid]._dmode = mode;
+}
+
+void setScreenSizeMode(SizeMode mode, int screenid)
+{
+  assert(0 <= screenid && screenid < screens.size());
+  auto& screen = screens[screenid];
+  screen._smode = mode;
+  autoAdjustScreen(windowSize, screen);
+}
+
+void setScreenPositionMode(PositionMode mode, int screenid)
+{
+  assert(0 <= screenid && screenid < screens.size());
+  auto& screen = screens[screenid];
+  screen._pmode = mode;
+  autoAdjustScreen(windowSize, screen);
+}
+
+void setScreenManualPosition(Vector2i position, int screenid)
+{
+  assert(0 <= screenid && screenid < screens.size());
   auto& screen = screens[screenid];
   screen._manualPosition = position;
   if(screen._pmode == PositionMode::MANUAL)
@@ -962,6 +3400,27 @@ void setPixelShader(PXShader_t shader, int screenid)
   assert(0 <= screenid && screenid < screens.size());
   auto& screen = screens[screenid];
   screen._pxShader = shader;
+  screen._spanShader = nullptr;
+}
+
+void setSpanShader(SpanShader_t shader, int screenid)
+{
+  assert(shader != nullptr);
+  assert(0 <= screenid && screenid < screens.size());
+  auto& screen = screens[screenid];
+  screen._spanShader = shader;
+}
+
+void setScreenPalette(const Palette_t& palette, int screenid)
+{
+  assert(0 <= screenid && screenid < screens.size());
+  auto& screen = screens[screenid];
+  assert(screen._cmode == ColorMode::PALETTE8);
+  screen._palette = palette;
+  screen._palette[PALETTE_KEY] = Color4u{ALPHA_KEY, ALPHA_KEY, ALPHA_KEY, ALPHA_KEY};
+  screen._isPaletteStale = true;
+  if(presentMode == PresentMode::COMPOSITE)
+    isCompositeStale = true;
 }
 
 void enableScreen(int screenid)
@@ -976,51 +3435,54 @@ void disableScreen(int screenid)
   screens[screenid]._isEnabled = false;
 }
 
-Vector2i calculateTextSize(const std::string& text, ResourceKey_t fontKey)
+Vector2i calculateTextSize(std::string_view text, ResourceKey_t fontKey)
 {
-  Vector2i size{0, 0};
-
-  auto search = fonts.find(fontKey);
-  assert(search != fonts.end());
-  auto& font = search->second._font;
+  if(const TextRun* textRun = peekTextRun(fontKey, text))
+    return textRun->_textSize;
+  return measureText(fonts[fontKey]._font, text);
+}
 
-  for(char c : text){
-    if(c == '\n') continue;
-    assert(' ' <= c && c <= '~');
-    const Glyph& glyph = font._glyphs[static_cast<int>(c - ' ')];
-    size._x += glyph._xadvance + font._glyphSpace;
-    size._y = size._y < glyph._height ? glyph._height : size._y;
-  }
-  return size;
+const TextRunCacheStats& getTextRunCacheStats()
+{
+  return textRunCacheStats;
 }
 
 bool isErrorSpritesheet(ResourceKey_t sheetKey)
 {
-  auto search = spritesheets.find(sheetKey);
-  assert(search != spritesheets.end());
-  return search->second._name == errorSpritesheetName;
+  const std::string& name = spritesheets[sheetKey]._name;
+  return name == errorSpritesheetName || name == errorPaletteSpritesheetName;
 }
 
 Vector2i getSpritesheetSize(ResourceKey_t sheetKey)
 {
-  auto search = spritesheets.find(sheetKey);
-  assert(search != spritesheets.end());
-  return search->second._sheet._image.getSize();
+  return spritesheets[sheetKey]._sheet._image.getSize();
 }
 
 Vector2i getSpriteSize(ResourceKey_t sheetKey, int spriteid)
 {
-  auto search = spritesheets.find(sheetKey);
-  assert(search != spritesheets.end());
-  assert(0 <= spriteid && spriteid < search->second._sheet._sprites.size());
-  return search->second._sheet._sprites[spriteid]._size;
+  const auto& sheet = spritesheets[sheetKey]._sheet;
+  assert(0 <= spriteid && spriteid < sheet._sprites.size());
+  return sheet._sprites[spriteid]._size;
 }
 
 const Spritesheet& getSpritesheet(ResourceKey_t sheetKey)
 {
-  auto search = spritesheets.find(sheetKey);
-  assert(search != spritesheets.end());
-  return search->second._sheet;
+  return spritesheets[sheetKey]._sheet;
+}
+
+bool isErrorSpriteMask(ResourceKey_t maskKey)
+{
+  return spriteMasks[maskKey]._name == errorSpriteMaskName;
+}
+
+Vector2i getSpriteMaskSize(ResourceKey_t maskKey)
+{
+  return spriteMasks[maskKey]._mask._size;
+}
+
+const SpriteMask& getSpriteMask(ResourceKey_t maskKey)
+{
+  return spriteMasks[maskKey]._mask;
 }
 
 } // namespace gfx
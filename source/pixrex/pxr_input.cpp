@@ -2,9 +2,14 @@
 #include <vector>
 #include <cassert>
 #include <string>
+#include <fstream>
+#include <cstdint>
 #include <SDL2/SDL_events.h>
 
 #include "pxr_input.h"
+#include "pxr_rand.h"
+#include "pxr_log.h"
+#include "pxr_alloc.h"
 
 namespace pxr
 {
@@ -14,6 +19,28 @@ namespace input
 static std::array<KeyLog, KEY_COUNT> keys;   // logs for all keys.
 static std::vector<KeyCode> history;         // ordered history of keys pressed.
 
+//
+// Recorded events are packed as the tick in the high 25 bits, the key in the next 6 and 
+// whether the key went down in the lowest bit.
+//
+static constexpr uint32_t RECORDING_MAGIC {0x52525850};    // "PXRR" in little endian.
+static constexpr uint32_t RECORDING_VERSION {1};
+static constexpr int EVENT_TICK_SHIFT {7};
+static constexpr int EVENT_KEY_SHIFT {1};
+static constexpr uint32_t EVENT_KEY_MASK {0x3f};
+static constexpr int RECORDING_RESERVE_EVENTS {4096};
+
+static_assert(KEY_COUNT <= EVENT_KEY_MASK, "key codes do not fit in recorded events");
+
+enum class Mode { LIVE, RECORDING, REPLAYING };
+
+static Mode mode {Mode::LIVE};
+static uint32_t tickNow;                     // ticks since the recording or replay started.
+static std::vector<uint32_t> events;         // the events recorded or being replayed.
+static size_t replayCursor;                  // the next event to replay.
+static uint32_t replayTickCount;             // the length of the recording being replayed.
+static rand::xorwow::state_type randState;   // the generator state when recording started.
+
 static KeyCode convertSdlKeyCode(int sdlCode)
 {
   switch(sdlCode) {
@@ -54,30 +81,78 @@ static KeyCode convertSdlKeyCode(int sdlCode)
   }
 }
 
+static void applyKeyEvent(KeyCode key, bool isDown)
+{
+  if(isDown){
+    keys[key]._isDown = true;
+    keys[key]._isPressed = true;
+    history.push_back(key);
+  }
+  else{
+    keys[key]._isDown = false;
+    keys[key]._isReleased = true;
+  }
+}
+
+static uint32_t packEvent(uint32_t tick, KeyCode key, bool isDown)
+{
+  return (tick << EVENT_TICK_SHIFT) | (static_cast<uint32_t>(key) << EVENT_KEY_SHIFT) | (isDown ? 1 : 0);
+}
+
+//
+// Recording may outlast the events reserved for it; the buffer then doubles, exempt from any
+// forbidding alloc scope as a long recording must not abort the frame which overflows it.
+//
+static void recordEvent(uint32_t event)
+{
+  if(events.size() == events.capacity()){
+    alloc::ForbidScope allowAllocs {false};
+    events.reserve(events.capacity() * 2);
+  }
+  events.push_back(event);
+}
+
+static void replayEvents()
+{
+  while(replayCursor < events.size() && (events[replayCursor] >> EVENT_TICK_SHIFT) <= tickNow){
+    uint32_t event = events[replayCursor++];
+    applyKeyEvent(static_cast<KeyCode>((event >> EVENT_KEY_SHIFT) & EVENT_KEY_MASK), event & 1);
+  }
+
+  if(replayCursor == events.size() && tickNow >= replayTickCount){
+    log::log(log::INFO, log::msg_inp_replay_done, "ticks=" + std::to_string(tickNow));
+    mode = Mode::LIVE;
+  }
+}
+
 void initialize()
 {
   for(auto& key : keys)
     key._isDown = key._isReleased = key._isPressed = false;
+  history.clear();
+  history.reserve(KEY_COUNT);
 }
 
 void onKeyEvent(const SDL_Event& event)
 {
   assert(event.type == SDL_KEYDOWN || event.type == SDL_KEYUP);
 
+  //
+  // Live keys would make the replay diverge from the recording.
+  //
+  if(mode == Mode::REPLAYING)
+    return;
+
   KeyCode key = convertSdlKeyCode(event.key.keysym.sym);
 
   if(key == KEY_COUNT) 
     return;
 
-  if(event.type == SDL_KEYDOWN){
-    keys[key]._isDown = true;
-    keys[key]._isPressed = true;
-    history.push_back(key);
-  }
-  else{
-    keys[key]._isDown = false;
-    keys[key]._isReleased = true;
-  }
+  bool isDown = event.type == SDL_KEYDOWN;
+  applyKeyEvent(key, isDown);
+
+  if(mode == Mode::RECORDING)
+    recordEvent(packEvent(tickNow, key, isDown));
 }
 
 void onUpdate()
@@ -85,6 +160,111 @@ void onUpdate()
   for(auto& key : keys)
     key._isPressed = key._isReleased = false;
   history.clear();
+
+  if(mode == Mode::LIVE)
+    return;
+
+  ++tickNow;
+  if(mode == Mode::REPLAYING)
+    replayEvents();
+}
+
+void startRecording()
+{
+  log::log(log::INFO, log::msg_inp_recording);
+  initialize();
+  events.clear();
+  events.reserve(RECORDING_RESERVE_EVENTS);
+  randState = rand::generator.getState();
+  tickNow = 0;
+  mode = Mode::RECORDING;
+}
+
+bool stopRecording(const char* filename)
+{
+  assert(mode == Mode::RECORDING);
+  mode = Mode::LIVE;
+
+  log::log(log::INFO, log::msg_inp_writing_recording, filename);
+
+  std::ofstream file {filename, std::ios_base::binary | std::ios_base::trunc};
+  if(!file){
+    log::log(log::ERROR, log::msg_inp_fail_open_recording, filename);
+    return false;
+  }
+
+  uint32_t eventCount = events.size();
+  file.write(reinterpret_cast<const char*>(&RECORDING_MAGIC), sizeof(RECORDING_MAGIC));
+  file.write(reinterpret_cast<const char*>(&RECORDING_VERSION), sizeof(RECORDING_VERSION));
+  file.write(reinterpret_cast<const char*>(randState.data()), sizeof(randState));
+  file.write(reinterpret_cast<const char*>(&tickNow), sizeof(tickNow));
+  file.write(reinterpret_cast<const char*>(&eventCount), sizeof(eventCount));
+  file.write(reinterpret_cast<const char*>(events.data()), eventCount * sizeof(uint32_t));
+
+  if(!file){
+    log::log(log::ERROR, log::msg_inp_fail_write_recording, filename);
+    return false;
+  }
+
+  log::log(log::INFO, log::msg_inp_recording_written, 
+           "events=" + std::to_string(eventCount) + " ticks=" + std::to_string(tickNow));
+  return true;
+}
+
+bool startReplay(const char* filename)
+{
+  std::ifstream file {filename, std::ios_base::binary};
+  if(!file){
+    log::log(log::ERROR, log::msg_inp_fail_open_recording, filename);
+    return false;
+  }
+
+  uint32_t magic {0}, version {0}, tickCount {0}, eventCount {0};
+  rand::xorwow::state_type state {};
+  file.read(reinterpret_cast<char*>(&magic), sizeof(magic));
+  file.read(reinterpret_cast<char*>(&version), sizeof(version));
+  file.read(reinterpret_cast<char*>(state.data()), sizeof(state));
+  file.read(reinterpret_cast<char*>(&tickCount), sizeof(tickCount));
+  file.read(reinterpret_cast<char*>(&eventCount), sizeof(eventCount));
+
+  if(!file || magic != RECORDING_MAGIC || version != RECORDING_VERSION){
+    log::log(log::ERROR, log::msg_inp_recording_corrupted, filename);
+    return false;
+  }
+
+  events.resize(eventCount);
+  file.read(reinterpret_cast<char*>(events.data()), eventCount * sizeof(uint32_t));
+  if(!file){
+    log::log(log::ERROR, log::msg_inp_recording_corrupted, filename);
+    events.clear();
+    return false;
+  }
+
+  log::log(log::INFO, log::msg_inp_replaying, filename);
+  initialize();
+  rand::generator.setState(state);
+  tickNow = 0;
+  replayCursor = 0;
+  replayTickCount = tickCount;
+  mode = Mode::REPLAYING;
+
+  replayEvents();     // events visible to the first tick.
+  return true;
+}
+
+void stopReplay()
+{
+  mode = Mode::LIVE;
+}
+
+bool isRecording()
+{
+  return mode == Mode::RECORDING;
+}
+
+bool isReplaying()
+{
+  return mode == Mode::REPLAYING;
 }
 
 bool isKeyDown(KeyCode key)
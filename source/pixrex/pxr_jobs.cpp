@@ -0,0 +1,404 @@
+#include <vector>
+#include <memory>
+#include <thread>
+#include <condition_variable>
+#include <chrono>
+#include <string>
+#include "pxr_jobs.h"
+#include "pxr_log.h"
+#include "pxr_profile.h"
+
+namespace pxr
+{
+namespace jobs
+{
+
+//
+// The number of times an idle worker looks for jobs to steal before sleeping.
+//
+static constexpr int IDLE_SPIN_COUNT {64};
+
+//
+// A job held in a deque. The members are atomics only as a thief may read a slot whilst its
+// owner overwrites it, in which case the thief discards what it read (see Deque::steal).
+//
+struct Slot
+{
+  std::atomic<JobFunction_t> _function;
+  std::atomic<void*> _data;
+  std::atomic<Counter*> _counter;
+};
+
+//
+// A fixed capacity Chase-Lev work stealing deque, from "Correct and Efficient Work-Stealing
+// for Weak Memory Models" (Le et al. 2013), with sequentially consistent loads and stores of
+// the ends in place of the fences. The owner pushes and pops at the bottom whilst thieves
+// steal from the top; only the last job is contended.
+//
+class Deque
+{
+public:
+  bool push(const Job& job);
+  bool pop(Job& job);
+  bool steal(Job& job);
+
+private:
+  void readSlot(int64_t index, Job& job) const;
+
+  static constexpr int64_t INDEX_MASK {DEQUE_CAPACITY - 1};
+
+  std::array<Slot, DEQUE_CAPACITY> _slots;
+  alignas(64) std::atomic<int64_t> _top {0};
+  alignas(64) std::atomic<int64_t> _bottom {0};
+};
+
+void Deque::readSlot(int64_t index, Job& job) const
+{
+  const Slot& slot = _slots[index & INDEX_MASK];
+  job._function = slot._function.load(std::memory_order_relaxed);
+  job._data = slot._data.load(std::memory_order_relaxed);
+  job._counter = slot._counter.load(std::memory_order_relaxed);
+}
+
+bool Deque::push(const Job& job)
+{
+  int64_t bottom = _bottom.load(std::memory_order_relaxed);
+  int64_t top = _top.load(std::memory_order_acquire);
+  if(bottom - top >= DEQUE_CAPACITY)
+    return false;
+
+  Slot& slot = _slots[bottom & INDEX_MASK];
+  slot._function.store(job._function, std::memory_order_relaxed);
+  slot._data.store(job._data, std::memory_order_relaxed);
+  slot._counter.store(job._counter, std::memory_order_relaxed);
+
+  _bottom.store(bottom + 1, std::memory_order_release);
+  return true;
+}
+
+bool Deque::pop(Job& job)
+{
+  int64_t bottom = _bottom.load(std::memory_order_relaxed) - 1;
+  _bottom.store(bottom, std::memory_order_seq_cst);
+  int64_t top = _top.load(std::memory_order_seq_cst);
+
+  if(top > bottom){
+    _bottom.store(bottom + 1, std::memory_order_relaxed);
+    return false;
+  }
+
+  readSlot(bottom, job);
+  if(top < bottom)
+    return true;
+
+  //
+  // The last job; race the thieves for it.
+  //
+  bool isWon = _top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+  _bottom.store(bottom + 1, std::memory_order_relaxed);
+  return isWon;
+}
+
+bool Deque::steal(Job& job)
+{
+  int64_t top = _top.load(std::memory_order_seq_cst);
+  int64_t bottom = _bottom.load(std::memory_order_seq_cst);
+  if(top >= bottom)
+    return false;
+
+  readSlot(top, job);
+  return _top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+}
+
+//
+// The stats are atomics so they can be read whilst the worker runs; only the worker writes
+// them.
+//
+struct Worker
+{
+  Deque _deque;
+  std::atomic<int64_t> _busyNanos {0};
+  std::atomic<int64_t> _jobsDone {0};
+  std::atomic<int64_t> _jobsStolen {0};
+  std::thread _thread;
+};
+
+static std::vector<std::unique_ptr<Worker>> workers;    // empty until initialized.
+static int workerCount {1};
+static thread_local int workerIndex {-1};               // -1 on threads which are not workers.
+
+//
+// Jobs run from threads which are not workers.
+//
+static std::mutex sharedMutex;
+static std::array<Job, DEQUE_CAPACITY> sharedJobs;
+static int sharedFront {0};
+static std::atomic<int> sharedCount {0};
+
+//
+// The count of jobs queued in all deques and the shared queue, kept so idle workers know
+// when to sleep and wake.
+//
+static std::atomic<int> queuedJobs {0};
+static std::atomic<int> sleepingWorkers {0};
+static std::mutex sleepMutex;
+static std::condition_variable sleepWake;
+static std::atomic<bool> isStopping {false};
+
+static void enqueueJob(const Job& job);
+
+//
+// A counter must not be destroyed whilst the job which zeroed it holds its mutex, so the last
+// job zeroes the counter whilst holding the mutex and wait locks the mutex before returning.
+//
+static void finishJob(Counter& counter)
+{
+  std::array<Job, MAX_CONTINUATIONS> continuations;
+  int continuationCount {0};
+
+  int pending = counter._pending.load(std::memory_order_relaxed);
+  while(true){
+    if(pending > 1){
+      if(counter._pending.compare_exchange_weak(pending, pending - 1, std::memory_order_acq_rel))
+        return;
+      continue;
+    }
+
+    std::lock_guard<std::mutex> lock {counter._continuationsMutex};
+    if(!counter._pending.compare_exchange_strong(pending, 0, std::memory_order_acq_rel))
+      continue;
+    continuationCount = counter._continuationCount;
+    std::copy_n(counter._continuations.begin(), continuationCount, continuations.begin());
+    counter._continuationCount = 0;
+    break;
+  }
+
+  //
+  // The continuations were counted against their counters when added.
+  //
+  for(int i = 0; i < continuationCount; ++i)
+    enqueueJob(continuations[i]);
+}
+
+static void executeJob(const Job& job)
+{
+  PXR_PROFILE_SCOPE("jobs::job");
+
+  auto start = std::chrono::steady_clock::now();
+  job._function(job._data);
+  auto end = std::chrono::steady_clock::now();
+
+  if(workerIndex >= 0 && workerIndex < static_cast<int>(workers.size())){
+    Worker& worker = *workers[workerIndex];
+    worker._busyNanos.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count(), std::memory_order_relaxed);
+    worker._jobsDone.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  if(job._counter != nullptr)
+    finishJob(*job._counter);
+}
+
+static void enqueueJob(const Job& job)
+{
+  if(workerCount == 1){
+    executeJob(job);
+    return;
+  }
+
+  queuedJobs.fetch_add(1, std::memory_order_seq_cst);
+
+  bool isQueued {false};
+  if(workerIndex >= 0)
+    isQueued = workers[workerIndex]->_deque.push(job);
+  else{
+    std::lock_guard<std::mutex> lock {sharedMutex};
+    int count = sharedCount.load(std::memory_order_relaxed);
+    if(count < DEQUE_CAPACITY){
+      sharedJobs[(sharedFront + count) % DEQUE_CAPACITY] = job;
+      sharedCount.store(count + 1, std::memory_order_release);
+      isQueued = true;
+    }
+  }
+
+  if(!isQueued){
+    queuedJobs.fetch_sub(1, std::memory_order_relaxed);
+    executeJob(job);
+    return;
+  }
+
+  //
+  // Locking ensures a worker which found no jobs is either waiting, so is notified, or has yet
+  // to check the queued count, so will see this job.
+  //
+  if(sleepingWorkers.load(std::memory_order_seq_cst) > 0){
+    { std::lock_guard<std::mutex> lock {sleepMutex}; }
+    sleepWake.notify_one();
+  }
+}
+
+//
+// Takes a job from the deque of the calling worker, else from the shared queue, else steals
+// from the deques of the other workers.
+//
+static bool takeJob(Job& job)
+{
+  if(workers.empty())
+    return false;
+
+  bool isTaken {false};
+  if(workerIndex >= 0)
+    isTaken = workers[workerIndex]->_deque.pop(job);
+
+  if(!isTaken && sharedCount.load(std::memory_order_acquire) > 0){
+    std::lock_guard<std::mutex> lock {sharedMutex};
+    int count = sharedCount.load(std::memory_order_relaxed);
+    if(count > 0){
+      job = sharedJobs[sharedFront];
+      sharedFront = (sharedFront + 1) % DEQUE_CAPACITY;
+      sharedCount.store(count - 1, std::memory_order_relaxed);
+      isTaken = true;
+    }
+  }
+
+  if(!isTaken){
+    int self = std::max(workerIndex, 0);
+    for(int i = 1; i <= workerCount && !isTaken; ++i){
+      int victim = (self + i) % workerCount;
+      if(victim != workerIndex)
+        isTaken = workers[victim]->_deque.steal(job);
+    }
+    if(isTaken && workerIndex >= 0)
+      workers[workerIndex]->_jobsStolen.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  if(isTaken)
+    queuedJobs.fetch_sub(1, std::memory_order_relaxed);
+  return isTaken;
+}
+
+static bool runOneJob()
+{
+  Job job;
+  if(!takeJob(job))
+    return false;
+  executeJob(job);
+  return true;
+}
+
+static void workerLoop(int index)
+{
+  workerIndex = index;
+  profile::setThreadName(("jobs worker " + std::to_string(index)).c_str());
+
+  while(true){
+    if(runOneJob())
+      continue;
+
+    bool isFound {false};
+    for(int i = 0; i < IDLE_SPIN_COUNT && !isFound; ++i){
+      std::this_thread::yield();
+      isFound = runOneJob();
+    }
+    if(isFound)
+      continue;
+
+    std::unique_lock<std::mutex> lock {sleepMutex};
+    sleepingWorkers.fetch_add(1, std::memory_order_seq_cst);
+    sleepWake.wait(lock, []{return queuedJobs.load(std::memory_order_seq_cst) > 0 || isStopping;});
+    sleepingWorkers.fetch_sub(1, std::memory_order_relaxed);
+    if(isStopping && queuedJobs.load() == 0)
+      return;
+  }
+}
+
+void initialize(int count)
+{
+  count = std::clamp(count, 1, MAX_WORKERS);
+  log::log(log::INFO, log::msg_job_workers, std::to_string(count));
+
+  isStopping = false;
+  workerIndex = 0;
+  for(int i = 0; i < count; ++i)
+    workers.push_back(std::make_unique<Worker>());
+  workerCount = count;
+  for(int i = 1; i < count; ++i)
+    workers[i]->_thread = std::thread{workerLoop, i};
+}
+
+void shutdown()
+{
+  {
+    std::lock_guard<std::mutex> lock {sleepMutex};
+    isStopping = true;
+  }
+  sleepWake.notify_all();
+
+  for(int i = 1; i < static_cast<int>(workers.size()); ++i)
+    workers[i]->_thread.join();
+
+  for(int i = 0; i < static_cast<int>(workers.size()); ++i){
+    WorkerStats stats = getWorkerStats(i);
+    log::log(log::INFO, log::msg_job_worker_stats,
+             "worker=" + std::to_string(i) +
+             " busyMs=" + std::to_string(stats._busyNanos / 1'000'000) +
+             " jobs=" + std::to_string(stats._jobsDone) +
+             " stolen=" + std::to_string(stats._jobsStolen));
+  }
+
+  workers.clear();
+  workerCount = 1;
+}
+
+int getWorkerCount()
+{
+  return workerCount;
+}
+
+void run(JobFunction_t function, void* data, Counter* counter)
+{
+  if(counter != nullptr)
+    counter->_pending.fetch_add(1, std::memory_order_relaxed);
+  enqueueJob(Job{function, data, counter});
+}
+
+void runAfter(Counter& dependency, JobFunction_t function, void* data, Counter* counter)
+{
+  if(counter != nullptr)
+    counter->_pending.fetch_add(1, std::memory_order_relaxed);
+  Job job {function, data, counter};
+
+  {
+    std::lock_guard<std::mutex> lock {dependency._continuationsMutex};
+    if(!dependency.isDone() && dependency._continuationCount < MAX_CONTINUATIONS){
+      dependency._continuations[dependency._continuationCount++] = job;
+      return;
+    }
+  }
+
+  if(!dependency.isDone())
+    wait(dependency);
+  enqueueJob(job);
+}
+
+void wait(Counter& counter)
+{
+  while(!counter.isDone())
+    if(!runOneJob())
+      std::this_thread::yield();
+
+  std::lock_guard<std::mutex> lock {counter._continuationsMutex};
+}
+
+WorkerStats getWorkerStats(int worker)
+{
+  if(worker < 0 || worker >= static_cast<int>(workers.size()))
+    return WorkerStats{0, 0, 0};
+  return WorkerStats{
+    workers[worker]->_busyNanos.load(std::memory_order_relaxed),
+    workers[worker]->_jobsDone.load(std::memory_order_relaxed),
+    workers[worker]->_jobsStolen.load(std::memory_order_relaxed)
+  };
+}
+
+} // namespace jobs
+} // namespace pxr
@@ -24,7 +24,7 @@ void shutdown()
     _os.close();
 }
 
-void log(Level level, const char* error, const std::string& addendum)
+void log(Level level, const char* error, std::string_view addendum)
 {
   std::ostream& os {_os ? _os : std::cerr}; 
   os << prefix[level] << LOG_DELIM << error;
@@ -0,0 +1,199 @@
+#include "pxr_profile.h"
+
+#ifdef PXR_PROFILE
+
+#include <array>
+#include <vector>
+#include <memory>
+#include <string>
+#include <mutex>
+#include <atomic>
+#include <fstream>
+#include <algorithm>
+#include <limits>
+#include <iomanip>
+#include "pxr_log.h"
+
+namespace pxr
+{
+namespace profile
+{
+
+//
+// A recorded scope. The members are atomics only so a trace can be written whilst the owning
+// thread records; relaxed atomics compile to plain loads and stores.
+//
+struct Event
+{
+  std::atomic<const char*> _name;
+  std::atomic<int64_t> _begin;
+  std::atomic<int64_t> _end;
+};
+
+//
+// The ring of events of a thread. A write of event n marks the write as begun before storing
+// the event and as done after, so a reader can tell which events may have been overwritten
+// whilst it read them (see writeTrace).
+//
+struct ThreadBuffer
+{
+  std::array<Event, EVENT_BUFFER_CAPACITY> _events;
+  std::atomic<int64_t> _writesBegun;
+  std::atomic<int64_t> _writesDone;
+  std::string _name;
+  int _tid;
+  bool _isOwned;                         // false once the owning thread has exited.
+};
+
+//
+// Buffers are never freed so the events of exited threads remain in traces until their buffer
+// is reused by a new thread.
+//
+static std::mutex buffersMutex;
+static std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+
+//
+// Releases the buffer of a thread on thread exit.
+//
+struct BufferLease
+{
+  ThreadBuffer* _buffer {nullptr};
+
+  ~BufferLease()
+  {
+    if(_buffer == nullptr)
+      return;
+    std::lock_guard<std::mutex> lock {buffersMutex};
+    _buffer->_isOwned = false;
+  }
+};
+
+static thread_local BufferLease lease;
+
+static ThreadBuffer* acquireBuffer()
+{
+  std::lock_guard<std::mutex> lock {buffersMutex};
+
+  auto it = std::find_if(buffers.begin(), buffers.end(), [](const auto& buffer){return !buffer->_isOwned;});
+  if(it == buffers.end()){
+    buffers.push_back(std::make_unique<ThreadBuffer>());
+    it = buffers.end() - 1;
+    (*it)->_tid = buffers.size();
+  }
+
+  ThreadBuffer* buffer = it->get();
+  buffer->_writesBegun.store(0, std::memory_order_relaxed);
+  buffer->_writesDone.store(0, std::memory_order_relaxed);
+  buffer->_name = "thread " + std::to_string(buffer->_tid);
+  buffer->_isOwned = true;
+  return buffer;
+}
+
+static ThreadBuffer* getThreadBuffer()
+{
+  if(lease._buffer == nullptr)
+    lease._buffer = acquireBuffer();
+  return lease._buffer;
+}
+
+void recordScope(const char* name, int64_t begin, int64_t end)
+{
+  ThreadBuffer* buffer = getThreadBuffer();
+  int64_t n = buffer->_writesDone.load(std::memory_order_relaxed);
+
+  buffer->_writesBegun.store(n + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  Event& event = buffer->_events[n % EVENT_BUFFER_CAPACITY];
+  event._name.store(name, std::memory_order_relaxed);
+  event._begin.store(begin, std::memory_order_relaxed);
+  event._end.store(end, std::memory_order_relaxed);
+
+  buffer->_writesDone.store(n + 1, std::memory_order_release);
+}
+
+void setThreadName(const char* name)
+{
+  ThreadBuffer* buffer = getThreadBuffer();
+  std::lock_guard<std::mutex> lock {buffersMutex};
+  buffer->_name = name;
+}
+
+//
+// Chrome expects timestamps in microseconds.
+//
+static void writeMicroseconds(std::ofstream& os, int64_t ns)
+{
+  os << (ns / 1000) << '.' << std::setw(3) << std::setfill('0') << (ns % 1000);
+}
+
+bool writeTrace(const char* filename)
+{
+  log::log(log::INFO, log::msg_prf_writing_trace, filename);
+
+  std::ofstream os {filename, std::ios_base::trunc};
+  if(!os){
+    log::log(log::ERROR, log::msg_prf_fail_open_trace, filename);
+    return false;
+  }
+
+  std::lock_guard<std::mutex> lock {buffersMutex};
+
+  //
+  // Timestamps are written relative to the earliest event to keep them short.
+  //
+  int64_t epoch {std::numeric_limits<int64_t>::max()};
+  for(const auto& buffer : buffers){
+    int64_t done = buffer->_writesDone.load(std::memory_order_acquire);
+    int64_t first = std::max<int64_t>(0, done - EVENT_BUFFER_CAPACITY);
+    for(int64_t n = first; n < done; ++n)
+      epoch = std::min(epoch, buffer->_events[n % EVENT_BUFFER_CAPACITY]._begin.load(std::memory_order_relaxed));
+  }
+
+  int eventCount {0};
+  bool isFirst {true};
+  os << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+  for(const auto& buffer : buffers){
+    os << (isFirst ? "" : ",") << "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->_tid
+       << ",\"args\":{\"name\":\"" << buffer->_name << "\"}}";
+    isFirst = false;
+
+    int64_t done = buffer->_writesDone.load(std::memory_order_acquire);
+    int64_t first = std::max<int64_t>(0, done - EVENT_BUFFER_CAPACITY);
+    for(int64_t n = first; n < done; ++n){
+      const Event& event = buffer->_events[n % EVENT_BUFFER_CAPACITY];
+      const char* name = event._name.load(std::memory_order_relaxed);
+      int64_t begin = event._begin.load(std::memory_order_relaxed);
+      int64_t end = event._end.load(std::memory_order_relaxed);
+
+      //
+      // Event n is overwritten by the write of event n + capacity; skip it if that write has
+      // begun.
+      //
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if(buffer->_writesBegun.load(std::memory_order_relaxed) > n + EVENT_BUFFER_CAPACITY)
+        continue;
+
+      os << ",\n{\"name\":\"" << name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->_tid << ",\"ts\":";
+      writeMicroseconds(os, begin - epoch);
+      os << ",\"dur\":";
+      writeMicroseconds(os, end - begin);
+      os << "}";
+      ++eventCount;
+    }
+  }
+  os << "\n]}\n";
+
+  if(!os){
+    log::log(log::ERROR, log::msg_prf_fail_write_trace, filename);
+    return false;
+  }
+
+  log::log(log::INFO, log::msg_prf_trace_written, "events=" + std::to_string(eventCount));
+  return true;
+}
+
+} // namespace profile
+} // namespace pxr
+
+#endif
@@ -11,6 +11,8 @@
 #include "pxr_sfx.h"
 #include "pxr_log.h"
 #include "pxr_wav.h"
+#include "pxr_handle.h"
+#include "pxr_profile.h"
 
 using namespace pxr::io;
 
@@ -75,8 +77,8 @@ struct SoundResource
 
 static ResourceName_t errorSoundName {"error_sound"};
 
-ResourceKey_t nextResourceKey {0};
-static std::map<ResourceKey_t, SoundResource> sounds;
+static HandleTable<SoundResource> sounds;
+static ResourceKey_t errorSoundKey {HandleTable<SoundResource>::NULL_HANDLE};
 
 /////////////////////////////////////////////////////////////////////////////////////////////////
 // MODULE FUNCTIONS
@@ -124,9 +126,7 @@ static void genErrorSound()
   alas(alGenBuffers(1, &resource._bufferKey));
   alas(alBufferData(resource._bufferKey, AL_FORMAT_MONO8, reinterpret_cast<void*>(pcm), sampleCount, sampleFreqHz));
 
-  ResourceKey_t newKey = nextResourceKey;
-  ++nextResourceKey;
-  sounds.emplace(std::make_pair(newKey, resource));
+  errorSoundKey = sounds.insert(std::move(resource));
 
   delete[] pcm;
 }
@@ -231,11 +231,11 @@ void shutdown()
     if(alIsSource(source.first))
       alas(alSourceStop(source.first));
 
-  for(auto& [key, resource] : sounds){
+  sounds.forEach([](ResourceKey_t soundKey, SoundResource& resource){
     if(alIsBuffer(resource._bufferKey)){
       alas(alDeleteBuffers(1, &resource._bufferKey));
     }
-  }
+  });
 
   sounds.clear();
 
@@ -246,30 +246,32 @@ void shutdown()
 
 static ResourceKey_t useErrorSound()
 {
-  for(auto& pair : sounds){
-    if(pair.second._name == errorSoundName){
-      pair.second._referenceCount++;
-      std::string addendum = "ref count=" + std::to_string(pair.second._referenceCount);
-      log::log(log::INFO, log::msg_sfx_using_error_sound, addendum);
-      return pair.first;
-    }
-  }
+  assert(sounds.isValid(errorSoundKey)); // This would mean the error sound has not been generated.
 
-  assert(0); // This would mean the error sprite has not been generated.
+  SoundResource& resource = sounds[errorSoundKey];
+  resource._referenceCount++;
+  std::string addendum = "ref count=" + std::to_string(resource._referenceCount);
+  log::log(log::INFO, log::msg_sfx_using_error_sound, addendum);
+  return errorSoundKey;
 }
 
 ResourceKey_t loadSound(ResourceName_t soundName)
 {
   log::log(log::INFO, log::msg_sfx_loading_sound, soundName);
 
-  for(auto& pair : sounds){
-    if(pair.second._name == soundName){
-      pair.second._referenceCount++;
-      std::string addendum {"ref count="};
-      addendum += std::to_string(pair.second._referenceCount);
-      log::log(log::INFO, log::msg_sfx_sound_already_loaded, addendum);
-      return pair.first;
-    }
+  ResourceKey_t loadedKey {sounds.NULL_HANDLE};
+  sounds.forEach([&loadedKey, soundName](ResourceKey_t soundKey, SoundResource& resource){
+    if(resource._name == soundName)
+      loadedKey = soundKey;
+  });
+
+  if(loadedKey != sounds.NULL_HANDLE){
+    SoundResource& resource = sounds[loadedKey];
+    resource._referenceCount++;
+    std::string addendum {"ref count="};
+    addendum += std::to_string(resource._referenceCount);
+    log::log(log::INFO, log::msg_sfx_sound_already_loaded, addendum);
+    return loadedKey;
   }
 
   Wav wav {};
@@ -303,9 +305,7 @@ ResourceKey_t loadSound(ResourceName_t soundName)
   resource._name = soundName;
   resource._referenceCount = 1;
 
-  ResourceKey_t newKey = nextResourceKey;
-  ++nextResourceKey;
-  sounds.emplace(std::make_pair(newKey, resource));
+  ResourceKey_t newKey = sounds.insert(std::move(resource));
 
   std::string addendum{};
   addendum += "[name:key]=[";
@@ -320,31 +320,32 @@ ResourceKey_t loadSound(ResourceName_t soundName)
 
 void unloadSound(ResourceKey_t soundKey)
 {
-  auto search = sounds.find(soundKey);
-  if(search == sounds.end()){
+  SoundResource* resource = sounds.find(soundKey);
+  if(resource == nullptr){
     log::log(log::WARN, log::msg_sfx_unloading_nonexistent_sound, std::to_string(soundKey));
     return;
   }
 
-  SoundResource& resource = search->second;
-  resource._referenceCount--;
-  if(resource._referenceCount <= 0 && resource._name != errorSoundName){
+  resource->_referenceCount--;
+  if(resource->_referenceCount <= 0 && resource->_name != errorSoundName){
     stopSound(soundKey);
-    if(alIsBuffer(resource._bufferKey))
-      alec(alDeleteBuffers(1, &resource._bufferKey), 0);
-    sounds.erase(search);
+    if(alIsBuffer(resource->_bufferKey))
+      alec(alDeleteBuffers(1, &resource->_bufferKey), 0);
+    sounds.erase(soundKey);
     log::log(log::INFO, log::msg_sfx_unload_sound_success, "key=" + std::to_string(soundKey));
   }
 }
 
 void playSound(ResourceKey_t soundKey, bool loop)
 {
-  auto search = sounds.find(soundKey);
-  if(search == sounds.end()){
+  PXR_PROFILE_SCOPE("sfx::playSound");
+
+  SoundResource* resource = sounds.find(soundKey);
+  if(resource == nullptr){
     log::log(log::WARN, log::msg_sfx_playing_nonexistent_sound, "key=" + std::to_string(soundKey));
     return;
   }
-  SoundBufferKey_t buffer = search->second._bufferKey;
+  SoundBufferKey_t buffer = resource->_bufferKey;
 
   for(auto source : soundSources){
     ALint state;